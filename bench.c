@@ -18,13 +18,44 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+/* Parses a corpus of messages over and over and reports, per message,
+ * ns/message with its relative standard deviation over the repetitions,
+ * bytes/ns and cycles/byte. The corpus is the samples below, the messages
+ * of test_messages.h and every file in the directories on the command
+ * line, one message per file:
+ *
+ *   ./bench [-r repetitions] [-s] [-l] [-c] [infinite] [directory ...]
+ *
+ * -s replays the whole corpus cut into pieces in different ways instead,
+ * to show what resuming a parse costs, and reports callbacks/message too.
+ * -l times each parse on its own and reports latency percentiles per
+ * message instead of means, for the tail that rare paths and cache misses
+ * cause; each is the top of its histogram bucket, capped at the maximum. -c splits the time between the parser and each callback, with
+ * http_parser_execute_timed().
+ * "infinite" parses the corpus forever without reporting, for profilers.
+ * Built with HTTP_PARSER_STATS (make bench_stats), it parses the corpus
+ * once and prints the parser's counters instead of timing anything.
+ * Cycles are time stamp counter ticks and only available on x86.
+ */
 #include "http_parser.h"
+#include "test_messages.h"
 #include <assert.h>
+#include <dirent.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <x86intrin.h>
+# define HAVE_CYCLES 1
+#else
+# define HAVE_CYCLES 0
+#endif
 
-static const char data[] =
+/* Chunked POST; the body goes through the incremental engine */
+static const char post_data[] =
     "POST /joyent/http-parser HTTP/1.1\r\n"
     "Host: github.com\r\n"
     "DNT: 1\r\n"
@@ -39,21 +70,81 @@ static const char data[] =
     "Connection: keep-alive\r\n"
     "Transfer-Encoding: chunked\r\n"
     "Cache-Control: max-age=0\r\n\r\nb\r\nhello world\r\n0\r\n\r\n";
-static const size_t data_len = sizeof(data) - 1;
+
+/* The same head without a body; with HTTP_PARSER_HEADER_BLOCK, parsed
+ * entirely as a header block
+ */
+static const char get_data[] =
+    "GET /joyent/http-parser HTTP/1.1\r\n"
+    "Host: github.com\r\n"
+    "DNT: 1\r\n"
+    "Accept-Encoding: gzip, deflate, sdch\r\n"
+    "Accept-Language: ru-RU,ru;q=0.8,en-US;q=0.6,en;q=0.4\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_10_1) "
+        "AppleWebKit/537.36 (KHTML, like Gecko) "
+        "Chrome/39.0.2171.65 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+        "image/webp,*/*;q=0.8\r\n"
+    "Referer: https://github.com/joyent/http-parser\r\n"
+    "Connection: keep-alive\r\n"
+    "Cache-Control: max-age=0\r\n\r\n";
+
+/* A typical response head with a short Content-Length body */
+static const char response_data[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Server: nginx\r\n"
+    "Date: Thu, 01 Jan 2015 00:00:00 GMT\r\n"
+    "Content-Type: text/html; charset=utf-8\r\n"
+    "Content-Length: 11\r\n"
+    "Connection: keep-alive\r\n"
+    "Vary: Accept-Encoding\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Set-Cookie: logged_in=no; domain=.github.com; path=/; "
+        "expires=Mon, 01 Jan 2035 00:00:00 GMT; secure; HttpOnly\r\n"
+    "X-Frame-Options: deny\r\n"
+    "\r\nhello world";
+
+struct sample {
+  const char *name;
+  enum http_parser_type type;
+  const char *data;
+  size_t len;
+  size_t messages;              /* how many messages `data` holds */
+};
+
+static struct sample *samples;
+static size_t num_samples;
+
+/* Bytes each repetition parses, whatever the size of the message */
+#define REPETITION_BYTES (2 * 1024 * 1024)
+
+static int repetitions = 10;
+
+static size_t callbacks;
 
 static int on_info(http_parser* p) {
+  callbacks++;
   return 0;
 }
 
 
 static int on_data(http_parser* p, const char *at, size_t length) {
+  callbacks++;
+  return 0;
+}
+
+static size_t messages_completed;
+
+static int on_message_complete(http_parser* p) {
+  callbacks++;
+  messages_completed++;
   return 0;
 }
 
 static http_parser_settings settings = {
   .on_message_begin = on_info,
   .on_headers_complete = on_info,
-  .on_message_complete = on_info,
+  .on_message_complete = on_message_complete,
   .on_header_field = on_data,
   .on_header_value = on_data,
   .on_url = on_data,
@@ -61,51 +152,828 @@ static http_parser_settings settings = {
   .on_body = on_data
 };
 
-int bench(int iter_count, int silent) {
+static void add_sample(const char *name, enum http_parser_type type,
+                       const char *data, size_t len) {
+  struct sample *s;
+
+  samples = realloc(samples, (num_samples + 1) * sizeof(*samples));
+  assert(samples != NULL);
+
+  s = &samples[num_samples++];
+  s->name = name;
+  s->type = type;
+  s->data = data;
+  s->len = len;
+  s->messages = 1;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/* Every file in `dir` is a message; the ones that start with "HTTP/" are
+ * responses
+ */
+static void add_directory(const char *dir) {
+  char **names = NULL;
+  size_t num_names = 0;
+  struct dirent *entry;
+  DIR *d = opendir(dir);
+  size_t i;
+
+  if (d == NULL) {
+    perror(dir);
+    exit(1);
+  }
+
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+    names = realloc(names, (num_names + 1) * sizeof(*names));
+    assert(names != NULL);
+    names[num_names] = strdup(entry->d_name);
+    assert(names[num_names] != NULL);
+    num_names++;
+  }
+  closedir(d);
+
+  qsort(names, num_names, sizeof(*names), compare_names);
+
+  for (i = 0; i < num_names; i++) {
+    char path[4096];
+    char *data;
+    long len;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+    f = fopen(path, "rb");
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0) {
+      perror(path);
+      exit(1);
+    }
+    rewind(f);
+
+    data = malloc(len > 0 ? len : 1);
+    assert(data != NULL);
+    if (fread(data, 1, len, f) != (size_t) len) {
+      perror(path);
+      exit(1);
+    }
+    fclose(f);
+
+    add_sample(strdup(path),
+               len >= 5 && memcmp(data, "HTTP/", 5) == 0 ? HTTP_RESPONSE
+                                                         : HTTP_REQUEST,
+               data, len);
+    free(names[i]);
+  }
+
+  free(names);
+}
+
+static void add_messages(const struct message *m) {
+  for (; m->name != NULL; m++) {
+    add_sample(m->name, m->type, m->raw, strlen(m->raw));
+  }
+}
+
+static enum http_errno parse_sample(const struct sample *s) {
+  http_parser parser;
+  size_t parsed;
+
+  http_parser_init(&parser, s->type);
+  parsed = http_parser_execute(&parser, &settings, s->data, s->len);
+
+  /* Some messages end at EOF; upgrades stop early on purpose */
+  if (parsed == s->len && !parser.upgrade) {
+    http_parser_execute(&parser, &settings, NULL, 0);
+  }
+
+  return HTTP_PARSER_ERRNO(&parser);
+}
+
+static void run_sample(const void *ctx, int iter_count) {
+  const struct sample *s = ctx;
+  int i;
+
+  for (i = 0; i < iter_count; i++) {
+    parse_sample(s);
+  }
+}
+
+static void run_header_array(const void *ctx, int iter_count) {
+  const struct sample *s = ctx;
   struct http_parser parser;
+  struct http_parser_header headers[32];
+  const char *url;
+  size_t url_len;
+  size_t num_headers;
   int i;
-  int err;
-  struct timeval start;
-  struct timeval end;
-  float rps;
 
-  if (!silent) {
-    err = gettimeofday(&start, NULL);
-    assert(err == 0);
+  for (i = 0; i < iter_count; i++) {
+    int parsed;
+    http_parser_init(&parser, HTTP_REQUEST);
+
+    num_headers = sizeof(headers) / sizeof(headers[0]);
+    parsed = http_parser_parse_request_headers(&parser, s->data, s->len,
+                                               &url, &url_len,
+                                               headers, &num_headers);
+    assert(parsed == (int) s->len);
   }
+}
+
+/* A connection per message, with the parser from a pool */
+static void run_pooled(const void *ctx, int iter_count) {
+  const struct sample *s = ctx;
+  struct http_parser_pool pool;
+  http_parser parsers[16];
+  int i;
+
+  http_parser_pool_init(&pool, s->type);
+  http_parser_pool_add(&pool, parsers, 16);
 
   for (i = 0; i < iter_count; i++) {
+    http_parser *parser = http_parser_pool_acquire(&pool, NULL);
     size_t parsed;
-    http_parser_init(&parser, HTTP_REQUEST);
 
-    parsed = http_parser_execute(&parser, &settings, data, data_len);
-    assert(parsed == data_len);
+    parsed = http_parser_execute(parser, &settings, s->data, s->len);
+    assert(parsed == s->len);
+    http_parser_pool_release(&pool, parser);
+  }
+}
+
+/* Many keep-alive connections that each get a request per round, with its
+ * own parser and buffer, like an event loop that wakes up to lots of
+ * readable sockets. `batch` connections go to http_parser_execute_batch()
+ * at once; 1 runs them one at a time.
+ */
+#define CONNECTIONS 4096
+
+struct connections {
+  http_parser parsers[CONNECTIONS];
+  http_parser *parser_ptrs[CONNECTIONS];
+  const char *bufs[CONNECTIONS];
+  size_t lens[CONNECTIONS];
+  size_t parsed[CONNECTIONS];
+  size_t batch;
+};
+
+static struct connections *connections_new(const char *data, size_t len,
+                                           size_t batch) {
+  struct connections *c = malloc(sizeof(*c));
+  char *copies = malloc(CONNECTIONS * len);
+  size_t i;
+
+  assert(c != NULL && copies != NULL);
+  for (i = 0; i < CONNECTIONS; i++) {
+    http_parser_init(&c->parsers[i], HTTP_REQUEST);
+    c->parser_ptrs[i] = &c->parsers[i];
+    memcpy(copies + i * len, data, len);
+    c->bufs[i] = copies + i * len;
+    c->lens[i] = len;
+  }
+  c->batch = batch;
+
+  return c;
+}
+
+static void connections_free(struct connections *c) {
+  free((char *) c->bufs[0]);
+  free(c);
+}
+
+static void run_connections(const void *ctx, int iter_count) {
+  struct connections *c = (struct connections *) ctx;
+  size_t i;
+  int r;
+
+  for (r = 0; r < iter_count; r++) {
+    for (i = 0; i < CONNECTIONS; i += c->batch) {
+      if (c->batch == 1) {
+        c->parsed[i] = http_parser_execute(&c->parsers[i], &settings,
+                                           c->bufs[i], c->lens[i]);
+      } else {
+        http_parser_execute_batch(c->parser_ptrs + i, &settings, c->bufs + i,
+                                  c->lens + i, c->batch, c->parsed + i);
+      }
+    }
+
+    for (i = 0; i < CONNECTIONS; i++) {
+      assert(c->parsed[i] == c->lens[i]);
+    }
+  }
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  int err = clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  assert(err == 0);
+  return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t now_cycles(void) {
+#if HAVE_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* Totals over everything measure() reported */
+static double total_ns;
+static double total_bytes;
+static double total_messages;
+
+/* Runs `run` once to warm up, then `repetitions` times, each time for
+ * enough iterations to parse about REPETITION_BYTES, and prints the
+ * results, without ending the line. An iteration parses `bytes` bytes in
+ * `messages` messages.
+ */
+static void measure_columns(const char *name,
+                            void (*run)(const void *, int), const void *ctx,
+                            size_t bytes, size_t messages, int silent) {
+  int iter_count = REPETITION_BYTES / (bytes > 0 ? bytes : 1);
+  double sum = 0, sum_sq = 0, mean, sd;
+  uint64_t cycles = 0, ns = 0;
+  int r;
+
+  if (iter_count < 1)
+    iter_count = 1;
+
+  run(ctx, iter_count);
+
+  for (r = 0; r < repetitions; r++) {
+    uint64_t start_ns = now_ns();
+    uint64_t start_cycles = now_cycles();
+    double per_message;
+
+    run(ctx, iter_count);
+
+    cycles += now_cycles() - start_cycles;
+    per_message = (double) (now_ns() - start_ns);
+    ns += (uint64_t) per_message;
+    per_message /= (double) iter_count * messages;
+
+    sum += per_message;
+    sum_sq += per_message * per_message;
+  }
+
+  if (silent)
+    return;
+
+  mean = sum / repetitions;
+  sd = sqrt(fmax(0, sum_sq / repetitions - mean * mean));
+
+  total_ns += ns;
+  total_bytes += (double) bytes * iter_count * repetitions;
+  total_messages += (double) messages * iter_count * repetitions;
+
+  printf("%-40.40s %10.1f %6.1f%% %9.3f", name, mean,
+         mean > 0 ? 100 * sd / mean : 0,
+         (double) bytes * iter_count * repetitions / ns);
+  if (HAVE_CYCLES) {
+    printf(" %11.2f",
+           (double) cycles / ((double) bytes * iter_count * repetitions));
+  } else {
+    printf(" %11s", "-");
   }
+}
 
+/* measure_columns() as a line of its own */
+static void measure(const char *name, void (*run)(const void *, int),
+                    const void *ctx, size_t bytes, size_t messages,
+                    int silent) {
+  measure_columns(name, run, ctx, bytes, messages, silent);
   if (!silent) {
-    err = gettimeofday(&end, NULL);
-    assert(err == 0);
+    putchar('\n');
+    fflush(stdout);
+  }
+}
+
+/* How the split benchmark cuts each message into the pieces that
+ * http_parser_execute() sees
+ */
+enum split_strategy
+  { SPLIT_WHOLE
+  , SPLIT_BYTES
+  , SPLIT_MSS
+  , SPLIT_RANDOM
+  , SPLIT_TOKENS
+  , SPLIT_MAX
+  };
+
+static const char *split_names[] =
+  { "whole"
+  , "1 byte"
+  , "1460 bytes (MSS)"
+  , "random, 1-64 bytes"
+  , "around every delimiter"
+  };
+
+/* The corpus under one strategy: pieces[i] holds the lengths of the
+ * pieces of samples[i]
+ */
+struct split_corpus {
+  size_t **pieces;
+  size_t *num_pieces;
+};
+
+static int is_delimiter(char c) {
+  return strchr(" \t\r\n:;,=/?&", c) != NULL && c != '\0';
+}
+
+static struct split_corpus *split_corpus_new(enum split_strategy strategy) {
+  struct split_corpus *c = malloc(sizeof(*c));
+  unsigned int seed = 1;
+  size_t i;
 
-    fprintf(stdout, "Benchmark result:\n");
+  assert(c != NULL);
+  c->pieces = calloc(num_samples, sizeof(*c->pieces));
+  c->num_pieces = calloc(num_samples, sizeof(*c->num_pieces));
+  assert(c->pieces != NULL && c->num_pieces != NULL);
 
-    rps = (float) (end.tv_sec - start.tv_sec) +
-          (end.tv_usec - start.tv_usec) * 1e-6f;
-    fprintf(stdout, "Took %f seconds to run\n", rps);
+  for (i = 0; i < num_samples; i++) {
+    const char *data = samples[i].data;
+    size_t len = samples[i].len;
+    size_t off = 0, n;
+
+    /* Never more pieces than bytes */
+    c->pieces[i] = malloc((len > 0 ? len : 1) * sizeof(**c->pieces));
+    assert(c->pieces[i] != NULL);
+
+    while (off < len) {
+      switch (strategy) {
+        case SPLIT_WHOLE:
+          n = len;
+          break;
+        case SPLIT_BYTES:
+          n = 1;
+          break;
+        case SPLIT_MSS:
+          n = 1460;
+          break;
+        case SPLIT_RANDOM:
+          seed = seed * 1103515245 + 12345;
+          n = 1 + (seed >> 16) % 64;
+          break;
+        default:
+          /* A delimiter on its own; everything between two in one piece */
+          n = 1;
+          if (!is_delimiter(data[off])) {
+            while (off + n < len && !is_delimiter(data[off + n]))
+              n++;
+          }
+          break;
+      }
+
+      if (n > len - off)
+        n = len - off;
+      c->pieces[i][c->num_pieces[i]++] = n;
+      off += n;
+    }
+  }
 
-    rps = (float) iter_count / rps;
-    fprintf(stdout, "%f req/sec\n", rps);
+  return c;
+}
+
+static void split_corpus_free(struct split_corpus *c) {
+  size_t i;
+
+  for (i = 0; i < num_samples; i++)
+    free(c->pieces[i]);
+  free(c->pieces);
+  free(c->num_pieces);
+  free(c);
+}
+
+static void run_split_corpus(const void *ctx, int iter_count) {
+  const struct split_corpus *c = ctx;
+  int iter;
+  size_t i, j;
+
+  for (iter = 0; iter < iter_count; iter++) {
+    for (i = 0; i < num_samples; i++) {
+      http_parser parser;
+      const char *data = samples[i].data;
+      size_t parsed = 0;
+
+      http_parser_init(&parser, samples[i].type);
+      for (j = 0; j < c->num_pieces[i]; j++) {
+        size_t n = http_parser_execute(&parser, &settings, data + parsed,
+                                       c->pieces[i][j]);
+
+        parsed += n;
+        if (n != c->pieces[i][j])
+          break;
+      }
+
+      if (parsed == samples[i].len && !parser.upgrade) {
+        http_parser_execute(&parser, &settings, NULL, 0);
+      }
+    }
+  }
+}
+
+static int bench_splits(void) {
+  size_t bytes = 0, messages = 0, i;
+  int strategy;
+
+  for (i = 0; i < num_samples; i++) {
+    bytes += samples[i].len;
+    messages += samples[i].messages;
+  }
+
+  printf("%-40s %10s %7s %9s %11s %13s\n", "split", "ns/msg", "+-",
+         "bytes/ns", "cycles/byte", "callbacks/msg");
+
+  for (strategy = 0; strategy < SPLIT_MAX; strategy++) {
+    struct split_corpus *c = split_corpus_new(strategy);
+    double callbacks_per_message;
+
+    callbacks = 0;
+    run_split_corpus(c, 1);
+    callbacks_per_message = (double) callbacks / messages;
+
+    measure_columns(split_names[strategy], run_split_corpus, c, bytes,
+                    messages, 0);
+    printf(" %13.1f\n", callbacks_per_message);
     fflush(stdout);
+
+    split_corpus_free(c);
+  }
+
+  return 0;
+}
+
+/* A log-linear histogram, as in HdrHistogram: values below HIST_SUB have
+ * a bucket each, and every power of two above is cut into HIST_SUB equal
+ * buckets, so a bucket is never wider than 1/HIST_SUB of its values.
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+struct histogram {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t max;
+};
+
+static unsigned int hist_index(uint64_t v) {
+  unsigned int msb = HIST_SUB_BITS, shift;
+
+  if (v < HIST_SUB)
+    return (unsigned int) v;
+
+  while (msb < 63 && (v >> (msb + 1)) != 0)
+    msb++;
+  shift = msb - HIST_SUB_BITS;
+  return (shift + 1) << HIST_SUB_BITS | ((v >> shift) & (HIST_SUB - 1));
+}
+
+/* The smallest value that goes into bucket `i` */
+static uint64_t hist_bucket_start(unsigned int i) {
+  if (i < HIST_SUB)
+    return i;
+  return (uint64_t) (HIST_SUB | (i & (HIST_SUB - 1))) <<
+         ((i >> HIST_SUB_BITS) - 1);
+}
+
+static void hist_record(struct histogram *h, uint64_t v) {
+  h->counts[hist_index(v)]++;
+  h->total++;
+  if (v > h->max)
+    h->max = v;
+}
+
+static void hist_add(struct histogram *to, const struct histogram *from) {
+  unsigned int i;
+
+  for (i = 0; i < HIST_BUCKETS; i++)
+    to->counts[i] += from->counts[i];
+  to->total += from->total;
+  if (from->max > to->max)
+    to->max = from->max;
+}
+
+/* The largest value of the bucket that holds quantile q, or the largest
+ * value recorded if that's smaller, so no percentile is above max
+ */
+static uint64_t hist_quantile(const struct histogram *h, double q) {
+  uint64_t rank = (uint64_t) ceil(q * h->total), seen = 0;
+  unsigned int i;
+
+  for (i = 0; i < HIST_BUCKETS - 1; i++) {
+    seen += h->counts[i];
+    if (seen >= rank && seen > 0)
+      break;
+  }
+  if (i + 1 < HIST_BUCKETS && hist_bucket_start(i + 1) - 1 < h->max)
+    return hist_bucket_start(i + 1) - 1;
+  return h->max;
+}
+
+/* Latencies are taken in cycles where there is a time stamp counter and in
+ * ns elsewhere; ticks_per_ns converts.
+ */
+static double ticks_per_ns = 1;
+
+static uint64_t now_ticks(void) {
+  return HAVE_CYCLES ? now_cycles() : now_ns();
+}
+
+static void calibrate_ticks(void) {
+  uint64_t start_ns = now_ns(), start_ticks = now_ticks(), ns;
+
+  if (!HAVE_CYCLES)
+    return;
+  do {
+    ns = now_ns() - start_ns;
+  } while (ns < 50 * 1000 * 1000);
+  ticks_per_ns = (double) (now_ticks() - start_ticks) / ns;
+}
+
+/* What two back to back now_ticks() cost, to take off every latency */
+static uint64_t timer_overhead(void) {
+  uint64_t best = UINT64_MAX;
+  int i;
+
+  for (i = 0; i < 1000; i++) {
+    uint64_t start = now_ticks();
+    uint64_t d = now_ticks() - start;
+    if (d < best)
+      best = d;
+  }
+  return best;
+}
+
+static void print_latencies(const char *name, const struct histogram *h) {
+  static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+  size_t i;
+
+  printf("%-40.40s", name);
+  for (i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+    printf(" %9.0f", hist_quantile(h, quantiles[i]) / ticks_per_ns);
+  }
+  printf(" %9.0f %10llu\n", h->max / ticks_per_ns,
+         (unsigned long long) h->total);
+  fflush(stdout);
+}
+
+/* Times every parse of every sample on its own, as many times as measure()
+ * would parse it, and prints percentiles of the latency in ns. A parse is
+ * http_parser_init() and http_parser_execute() of the whole message, plus
+ * the EOF.
+ */
+static int bench_latency(void) {
+  struct histogram *h = malloc(sizeof(*h));
+  struct histogram *all = calloc(1, sizeof(*all));
+  uint64_t overhead;
+  size_t i;
+
+  assert(h != NULL && all != NULL);
+  calibrate_ticks();
+  overhead = timer_overhead();
+
+  printf("percentiles are the top of their histogram bucket (at most 1/%d "
+         "over), capped at max\n", HIST_SUB);
+  printf("%-40s %9s %9s %9s %9s %9s %10s\n", "parse latency (ns)", "p50", "p90",
+         "p99", "p99.9", "max", "parses");
+
+  for (i = 0; i < num_samples; i++) {
+    const struct sample *s = &samples[i];
+    int iter_count = REPETITION_BYTES / (s->len > 0 ? s->len : 1);
+    int n;
+
+    if (iter_count < 1)
+      iter_count = 1;
+    run_sample(s, iter_count);
+
+    memset(h, 0, sizeof(*h));
+    for (n = 0; n < iter_count * repetitions; n++) {
+      uint64_t start = now_ticks();
+      uint64_t d;
+
+      parse_sample(s);
+      d = now_ticks() - start;
+      hist_record(h, d > overhead ? d - overhead : 0);
+    }
+
+    print_latencies(s->name, h);
+    hist_add(all, h);
+  }
+
+  print_latencies("all", all);
+
+  free(h);
+  free(all);
+  return 0;
+}
+
+static struct http_parser_timing timing;
+
+/* parse_sample() through http_parser_execute_timed() */
+static void run_sample_timed(const struct sample *s) {
+  http_parser parser;
+  size_t parsed;
+
+  http_parser_init(&parser, s->type);
+  parsed = http_parser_execute_timed(&parser, &settings, s->data, s->len,
+                                     &timing);
+  if (parsed == s->len && !parser.upgrade) {
+    http_parser_execute_timed(&parser, &settings, NULL, 0, &timing);
+  }
+}
+
+/* Splits the time of each sample between the parser and the callbacks,
+ * then the time of all samples between the callbacks. The callbacks of
+ * this benchmark only count, so their share is mostly the cost of calling
+ * them.
+ */
+static int bench_callbacks(void) {
+  struct http_parser_timing all;
+  size_t i;
+  int cb;
+
+  calibrate_ticks();
+  memset(&all, 0, sizeof(all));
+  timing.clock = now_ticks;
+
+  printf("%-40s %12s %12s %11s\n", "message (ns/msg)", "parser",
+         "callbacks", "callbacks%");
+
+  for (i = 0; i < num_samples; i++) {
+    const struct sample *s = &samples[i];
+    int iter_count = REPETITION_BYTES / (s->len > 0 ? s->len : 1);
+    double messages;
+    int n;
+
+    if (iter_count < 1)
+      iter_count = 1;
+    run_sample(s, iter_count);
+
+    memset(&timing, 0, sizeof(timing));
+    timing.clock = now_ticks;
+    for (n = 0; n < iter_count * repetitions; n++) {
+      run_sample_timed(s);
+    }
+
+    messages = (double) s->messages * iter_count * repetitions;
+    printf("%-40.40s %12.1f %12.1f %10.1f%%\n", s->name,
+           timing.parser / ticks_per_ns / messages,
+           timing.callbacks / ticks_per_ns / messages,
+           timing.total > 0 ? 100.0 * timing.callbacks / timing.total : 0);
+
+    all.total += timing.total;
+    all.parser += timing.parser;
+    all.callbacks += timing.callbacks;
+    for (cb = 0; cb < HTTP_PARSER_CALLBACKS; cb++) {
+      all.callback_time[cb] += timing.callback_time[cb];
+      all.callback_calls[cb] += timing.callback_calls[cb];
+    }
+  }
+
+  printf("%-40s %12s %12s %11.1f%%\n", "all", "", "",
+         all.total > 0 ? 100.0 * all.callbacks / all.total : 0);
+
+  printf("\n%-40s %12s %12s\n", "callback", "ns/call", "calls");
+  for (cb = 0; cb < HTTP_PARSER_CALLBACKS; cb++) {
+    const char *name =
+      http_errno_name((enum http_errno) (HPE_CB_message_begin + cb));
+
+    if (all.callback_calls[cb] == 0)
+      continue;
+    /* "HPE_CB_url" -> "on_url" */
+    printf("on_%-37s %12.1f %12llu\n", name + sizeof("HPE_CB_") - 1,
+           all.callback_time[cb] / ticks_per_ns / all.callback_calls[cb],
+           (unsigned long long) all.callback_calls[cb]);
+  }
+
+  return 0;
+}
+
+static int bench(int silent) {
+  static const struct sample get_sample =
+    { "GET", HTTP_REQUEST, get_data, sizeof(get_data) - 1, 1 };
+  const struct sample *get = &get_sample;
+  size_t i;
+
+  if (!silent) {
+    printf("%-40s %10s %7s %9s %11s\n",
+           "message", "ns/msg", "+-", "bytes/ns", "cycles/byte");
+  }
+
+  for (i = 0; i < num_samples; i++) {
+    measure(samples[i].name, run_sample, &samples[i], samples[i].len,
+            samples[i].messages, silent);
+  }
+
+  /* The GET again, into an array instead of through callbacks */
+  measure("GET, header array", run_header_array, get, get->len, 1, silent);
+
+  /* And through a parser from a pool instead of a new one */
+  measure("GET, pooled parser", run_pooled, get, get->len, 1, silent);
+
+  /* And over many connections, one at a time and in batches */
+  for (i = 0; i < 2; i++) {
+    struct connections *c = connections_new(get->data, get->len,
+                                            i == 0 ? 1 : 256);
+
+    measure(i == 0 ? "GET, 4096 connections"
+                   : "GET, 4096 connections, batches of 256",
+            run_connections, c, get->len * CONNECTIONS, CONNECTIONS,
+            silent);
+    connections_free(c);
+  }
+
+  if (!silent) {
+    printf("%-40s %10.1f %7s %9.3f\n", "all", total_ns / total_messages, "",
+           total_bytes / total_ns);
   }
 
   return 0;
 }
 
 int main(int argc, char** argv) {
-  if (argc == 2 && strcmp(argv[1], "infinite") == 0) {
+  int infinite = 0;
+  int splits = 0;
+  int latency = 0;
+  int callback_times = 0;
+  size_t i, kept;
+  int arg;
+
+  add_sample("chunked POST", HTTP_REQUEST, post_data, sizeof(post_data) - 1);
+  add_sample("GET", HTTP_REQUEST, get_data, sizeof(get_data) - 1);
+  add_sample("200 response", HTTP_RESPONSE, response_data,
+             sizeof(response_data) - 1);
+  add_messages(requests);
+  add_messages(responses);
+
+  for (arg = 1; arg < argc; arg++) {
+    if (strcmp(argv[arg], "infinite") == 0) {
+      infinite = 1;
+    } else if (strcmp(argv[arg], "-s") == 0) {
+      splits = 1;
+    } else if (strcmp(argv[arg], "-l") == 0) {
+      latency = 1;
+    } else if (strcmp(argv[arg], "-c") == 0) {
+      callback_times = 1;
+    } else if (strcmp(argv[arg], "-r") == 0 && arg + 1 < argc) {
+      repetitions = atoi(argv[++arg]);
+      if (repetitions < 1) {
+        fprintf(stderr, "bad repetition count: %s\n", argv[arg]);
+        return 1;
+      }
+    } else {
+      add_directory(argv[arg]);
+    }
+  }
+
+  /* Leave out what this build of the parser rejects */
+  for (i = 0, kept = 0; i < num_samples; i++) {
+    enum http_errno err;
+
+    messages_completed = 0;
+    err = parse_sample(&samples[i]);
+
+    if (err != HPE_OK) {
+      fprintf(stderr, "skipping %s: %s\n", samples[i].name,
+              http_errno_name(err));
+      continue;
+    }
+    if (messages_completed > 1) {
+      samples[i].messages = messages_completed;
+    }
+    samples[kept++] = samples[i];
+  }
+  num_samples = kept;
+
+#if HTTP_PARSER_STATS
+  http_parser_stats_reset();
+  for (i = 0; i < num_samples; i++) {
+    parse_sample(&samples[i]);
+  }
+  http_parser_stats_dump(stdout);
+  return 0;
+#endif
+
+  if (infinite) {
     for (;;)
-      bench(5000000, 1);
-    return 0;
-  } else {
-    return bench(5000000, 0);
+      bench(1);
   }
+
+  if (splits) {
+    return bench_splits();
+  }
+
+  if (latency) {
+    return bench_latency();
+  }
+
+  if (callback_times) {
+    return bench_callbacks();
+  }
+
+  return bench(0);
 }
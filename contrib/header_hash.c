@@ -0,0 +1,102 @@
+/* Generates the perfect hash tables used by http_parser.c to recognise the
+ * header names in HTTP_HEADER_MAP. Run it after changing the map and paste
+ * the output over header_hash_asso[] and header_hash_slots[].
+ *
+ * The hash of a lowercase name is
+ *
+ *   (length + asso[name[0]] + asso[name[length - 1]]) & 0xff
+ *
+ * and the generator searches for asso values that give every known name
+ * its own slot.
+ */
+
+#include "http_parser.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *names[] =
+  {
+  "",
+#define XX(num, name, string) #string,
+  HTTP_HEADER_MAP(XX)
+#undef XX
+  };
+
+#define NAMES (sizeof(names) / sizeof(names[0]))
+
+static unsigned char asso[256];
+static unsigned char slots[256];
+static unsigned long seed = 1;
+
+static unsigned int
+next_random (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (unsigned int) (seed >> 16) & 0xff;
+}
+
+static unsigned int
+hash (const char *name)
+{
+  size_t len = strlen(name);
+  return (len + asso[(unsigned char) name[0]] +
+          asso[(unsigned char) name[len - 1]]) & 0xff;
+}
+
+static int
+try_assign (void)
+{
+  unsigned int i;
+
+  memset(slots, 0, sizeof(slots));
+  for (i = 1; i < NAMES; i++) {
+    unsigned int h = hash(names[i]);
+    if (slots[h] != 0) {
+      return 0;
+    }
+    slots[h] = (unsigned char) i;
+  }
+
+  return 1;
+}
+
+static void
+print_table (const char *name, const unsigned char *table)
+{
+  unsigned int i;
+
+  printf("static const uint8_t %s[256] =\n  {", name);
+  for (i = 0; i < 256; i++) {
+    if (i % 16 == 0 && i != 0) {
+      printf("\n  ,");
+    } else if (i != 0) {
+      printf(",");
+    }
+    printf("%3u", table[i]);
+  }
+  printf("\n  };\n");
+}
+
+int main(void) {
+  unsigned long tries;
+  unsigned int i;
+
+  for (tries = 1; ; tries++) {
+    memset(asso, 0, sizeof(asso));
+    for (i = 1; i < NAMES; i++) {
+      const char *n = names[i];
+      asso[(unsigned char) n[0]] = next_random();
+      asso[(unsigned char) n[strlen(n) - 1]] = next_random();
+    }
+
+    if (try_assign()) {
+      break;
+    }
+  }
+
+  printf("/* %u names, found after %lu tries */\n",
+         (unsigned int) (NAMES - 1), tries);
+  print_table("header_hash_asso", asso);
+  print_table("header_hash_slots", slots);
+  return 0;
+}
@@ -22,12 +22,16 @@
  * IN THE SOFTWARE.
  */
 
-/* Dump what the parser finds to stdout as it happen */
+/* Dump what the parser finds to stdout as it happen, and where the time
+ * went to stderr
+ */
 
 #include "http_parser.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 int on_message_begin(http_parser* _) {
   (void)_;
@@ -71,6 +75,31 @@ int on_body(http_parser* _, const char* at, size_t length) {
   return 0;
 }
 
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void print_timing(const struct http_parser_timing* timing) {
+  int i;
+
+  fprintf(stderr, "Parser: %llu ns, callbacks: %llu ns\n",
+          (unsigned long long)timing->parser,
+          (unsigned long long)timing->callbacks);
+  for (i = 0; i < HTTP_PARSER_CALLBACKS; i++) {
+    if (timing->callback_calls[i] == 0) {
+      continue;
+    }
+    /* "HPE_CB_url" -> "on_url" */
+    fprintf(stderr, "  on_%s: %llu ns in %llu calls\n",
+            http_errno_name((enum http_errno)(HPE_CB_message_begin + i)) +
+                sizeof("HPE_CB_") - 1,
+            (unsigned long long)timing->callback_time[i],
+            (unsigned long long)timing->callback_calls[i]);
+  }
+}
+
 void usage(const char* name) {
   fprintf(stderr,
           "Usage: %s $type $filename\n"
@@ -139,10 +168,16 @@ int main(int argc, char* argv[]) {
   settings.on_body = on_body;
   settings.on_message_complete = on_message_complete;
 
+  struct http_parser_timing timing;
+  memset(&timing, 0, sizeof(timing));
+  timing.clock = now_ns;
+
   http_parser parser;
   http_parser_init(&parser, file_type);
-  size_t nparsed = http_parser_execute(&parser, &settings, data, file_length);
+  size_t nparsed = http_parser_execute_timed(&parser, &settings, data,
+                                             file_length, &timing);
   free(data);
+  print_timing(&timing);
 
   if (nparsed != (size_t)file_length) {
     fprintf(stderr,
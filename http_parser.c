@@ -21,358 +21,12 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
-#include "http_parser.h"
-#include <assert.h>
-#include <stddef.h>
-#include <ctype.h>
-#include <stdlib.h>
-#include <string.h>
-#include <limits.h>
-
-#ifndef ULLONG_MAX
-# define ULLONG_MAX ((uint64_t) -1) /* 2^64-1 */
-#endif
-
-#ifndef MIN
-# define MIN(a,b) ((a) < (b) ? (a) : (b))
-#endif
-
-#ifndef ARRAY_SIZE
-# define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
-#endif
-
-#ifndef BIT_AT
-# define BIT_AT(a, i)                                                \
-  (!!((unsigned int) (a)[(unsigned int) (i) >> 3] &                  \
-   (1 << ((unsigned int) (i) & 7))))
-#endif
-
-#ifndef ELEM_AT
-# define ELEM_AT(a, i, v) ((unsigned int) (i) < ARRAY_SIZE(a) ? (a)[(i)] : (v))
-#endif
-
-#define SET_ERRNO(e)                                                 \
-do {                                                                 \
-  parser->http_errno = (e);                                          \
-} while(0)
-
-#define CURRENT_STATE() p_state
-#define UPDATE_STATE(V) p_state = (enum state) (V);
-#define RETURN(V)                                                    \
-do {                                                                 \
-  parser->state = CURRENT_STATE();                                   \
-  return (V);                                                        \
-} while (0);
-#define REEXECUTE()                                                  \
-  goto reexecute;                                                    \
-
-
-#ifdef __GNUC__
-# define LIKELY(X) __builtin_expect(!!(X), 1)
-# define UNLIKELY(X) __builtin_expect(!!(X), 0)
-#else
-# define LIKELY(X) (X)
-# define UNLIKELY(X) (X)
-#endif
-
-
-/* Run the notify callback FOR, returning ER if it fails */
-#define CALLBACK_NOTIFY_(FOR, ER)                                    \
-do {                                                                 \
-  assert(HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
-                                                                     \
-  if (LIKELY(settings->on_##FOR)) {                                  \
-    parser->state = CURRENT_STATE();                                 \
-    if (UNLIKELY(0 != settings->on_##FOR(parser))) {                 \
-      SET_ERRNO(HPE_CB_##FOR);                                       \
-    }                                                                \
-    UPDATE_STATE(parser->state);                                     \
-                                                                     \
-    /* We either errored above or got paused; get out */             \
-    if (UNLIKELY(HTTP_PARSER_ERRNO(parser) != HPE_OK)) {             \
-      return (ER);                                                   \
-    }                                                                \
-  }                                                                  \
-} while (0)
-
-/* Run the notify callback FOR and consume the current byte */
-#define CALLBACK_NOTIFY(FOR)            CALLBACK_NOTIFY_(FOR, p - data + 1)
-
-/* Run the notify callback FOR and don't consume the current byte */
-#define CALLBACK_NOTIFY_NOADVANCE(FOR)  CALLBACK_NOTIFY_(FOR, p - data)
-
-/* Run data callback FOR with LEN bytes, returning ER if it fails */
-#define CALLBACK_DATA_(FOR, LEN, ER)                                 \
-do {                                                                 \
-  assert(HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
-                                                                     \
-  if (FOR##_mark) {                                                  \
-    if (LIKELY(settings->on_##FOR)) {                                \
-      parser->state = CURRENT_STATE();                               \
-      if (UNLIKELY(0 !=                                              \
-                   settings->on_##FOR(parser, FOR##_mark, (LEN)))) { \
-        SET_ERRNO(HPE_CB_##FOR);                                     \
-      }                                                              \
-      UPDATE_STATE(parser->state);                                   \
-                                                                     \
-      /* We either errored above or got paused; get out */           \
-      if (UNLIKELY(HTTP_PARSER_ERRNO(parser) != HPE_OK)) {           \
-        return (ER);                                                 \
-      }                                                              \
-    }                                                                \
-    FOR##_mark = NULL;                                               \
-  }                                                                  \
-} while (0)
-  
-/* Run the data callback FOR and consume the current byte */
-#define CALLBACK_DATA(FOR)                                           \
-    CALLBACK_DATA_(FOR, p - FOR##_mark, p - data + 1)
-
-/* Run the data callback FOR and don't consume the current byte */
-#define CALLBACK_DATA_NOADVANCE(FOR)                                 \
-    CALLBACK_DATA_(FOR, p - FOR##_mark, p - data)
-
-/* Set the mark FOR; non-destructive if mark is already set */
-#define MARK(FOR)                                                    \
-do {                                                                 \
-  if (!FOR##_mark) {                                                 \
-    FOR##_mark = p;                                                  \
-  }                                                                  \
-} while (0)
-
-/* Don't allow the total size of the HTTP headers (including the status
- * line) to exceed HTTP_MAX_HEADER_SIZE.  This check is here to protect
- * embedders against denial-of-service attacks where the attacker feeds
- * us a never-ending header that the embedder keeps buffering.
- *
- * This check is arguably the responsibility of embedders but we're doing
- * it on the embedder's behalf because most won't bother and this way we
- * make the web a little safer.  HTTP_MAX_HEADER_SIZE is still far bigger
- * than any reasonable request or response so this should never affect
- * day-to-day operation.
- */
-#define COUNT_HEADER_SIZE(V)                                         \
-do {                                                                 \
-  parser->nread += (V);                                              \
-  if (UNLIKELY(parser->nread > (HTTP_MAX_HEADER_SIZE))) {            \
-    SET_ERRNO(HPE_HEADER_OVERFLOW);                                  \
-    goto error;                                                      \
-  }                                                                  \
-} while (0)
-
-
-#define PROXY_CONNECTION "proxy-connection"
-#define CONNECTION "connection"
-#define CONTENT_LENGTH "content-length"
-#define TRANSFER_ENCODING "transfer-encoding"
-#define UPGRADE "upgrade"
-#define CHUNKED "chunked"
-#define KEEP_ALIVE "keep-alive"
-#define CLOSE "close"
-
+#include "http_parser_internal.h"
 
-static const char *method_strings[] =
-  {
-#define XX(num, name, string) #string,
-  HTTP_METHOD_MAP(XX)
-#undef XX
-  };
-
-
-/* Tokens as defined by rfc 2616. Also lowercases them.
- *        token       = 1*<any CHAR except CTLs or separators>
- *     separators     = "(" | ")" | "<" | ">" | "@"
- *                    | "," | ";" | ":" | "\" | <">
- *                    | "/" | "[" | "]" | "?" | "="
- *                    | "{" | "}" | SP | HT
- */
-static const char tokens[256] = {
-/*   0 nul    1 soh    2 stx    3 etx    4 eot    5 enq    6 ack    7 bel  */
-        0,       0,       0,       0,       0,       0,       0,       0,
-/*   8 bs     9 ht    10 nl    11 vt    12 np    13 cr    14 so    15 si   */
-        0,       0,       0,       0,       0,       0,       0,       0,
-/*  16 dle   17 dc1   18 dc2   19 dc3   20 dc4   21 nak   22 syn   23 etb */
-        0,       0,       0,       0,       0,       0,       0,       0,
-/*  24 can   25 em    26 sub   27 esc   28 fs    29 gs    30 rs    31 us  */
-        0,       0,       0,       0,       0,       0,       0,       0,
-/*  32 sp    33  !    34  "    35  #    36  $    37  %    38  &    39  '  */
-        0,      '!',      0,      '#',     '$',     '%',     '&',    '\'',
-/*  40  (    41  )    42  *    43  +    44  ,    45  -    46  .    47  /  */
-        0,       0,      '*',     '+',      0,      '-',     '.',      0,
-/*  48  0    49  1    50  2    51  3    52  4    53  5    54  6    55  7  */
-       '0',     '1',     '2',     '3',     '4',     '5',     '6',     '7',
-/*  56  8    57  9    58  :    59  ;    60  <    61  =    62  >    63  ?  */
-       '8',     '9',      0,       0,       0,       0,       0,       0,
-/*  64  @    65  A    66  B    67  C    68  D    69  E    70  F    71  G  */
-        0,      'a',     'b',     'c',     'd',     'e',     'f',     'g',
-/*  72  H    73  I    74  J    75  K    76  L    77  M    78  N    79  O  */
-       'h',     'i',     'j',     'k',     'l',     'm',     'n',     'o',
-/*  80  P    81  Q    82  R    83  S    84  T    85  U    86  V    87  W  */
-       'p',     'q',     'r',     's',     't',     'u',     'v',     'w',
-/*  88  X    89  Y    90  Z    91  [    92  \    93  ]    94  ^    95  _  */
-       'x',     'y',     'z',      0,       0,       0,      '^',     '_',
-/*  96  `    97  a    98  b    99  c   100  d   101  e   102  f   103  g  */
-       '`',     'a',     'b',     'c',     'd',     'e',     'f',     'g',
-/* 104  h   105  i   106  j   107  k   108  l   109  m   110  n   111  o  */
-       'h',     'i',     'j',     'k',     'l',     'm',     'n',     'o',
-/* 112  p   113  q   114  r   115  s   116  t   117  u   118  v   119  w  */
-       'p',     'q',     'r',     's',     't',     'u',     'v',     'w',
-/* 120  x   121  y   122  z   123  {   124  |   125  }   126  ~   127 del */
-       'x',     'y',     'z',      0,      '|',      0,      '~',       0 };
-
-
-static const int8_t unhex[256] =
-  {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  , 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1
-  ,-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  ,-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-  };
-
-
-#if HTTP_PARSER_STRICT
-# define T(v) 0
-#else
-# define T(v) v
+#if !defined(_WIN32)
+# include <sys/uio.h>
 #endif
 
-
-static const uint8_t normal_url_char[32] = {
-/*   0 nul    1 soh    2 stx    3 etx    4 eot    5 enq    6 ack    7 bel  */
-        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
-/*   8 bs     9 ht    10 nl    11 vt    12 np    13 cr    14 so    15 si   */
-        0    | T(2)   |   0    |   0    | T(16)  |   0    |   0    |   0,
-/*  16 dle   17 dc1   18 dc2   19 dc3   20 dc4   21 nak   22 syn   23 etb */
-        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
-/*  24 can   25 em    26 sub   27 esc   28 fs    29 gs    30 rs    31 us  */
-        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
-/*  32 sp    33  !    34  "    35  #    36  $    37  %    38  &    39  '  */
-        0    |   2    |   4    |   0    |   16   |   32   |   64   |  128,
-/*  40  (    41  )    42  *    43  +    44  ,    45  -    46  .    47  /  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/*  48  0    49  1    50  2    51  3    52  4    53  5    54  6    55  7  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/*  56  8    57  9    58  :    59  ;    60  <    61  =    62  >    63  ?  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |   0,
-/*  64  @    65  A    66  B    67  C    68  D    69  E    70  F    71  G  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/*  72  H    73  I    74  J    75  K    76  L    77  M    78  N    79  O  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/*  80  P    81  Q    82  R    83  S    84  T    85  U    86  V    87  W  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/*  88  X    89  Y    90  Z    91  [    92  \    93  ]    94  ^    95  _  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/*  96  `    97  a    98  b    99  c   100  d   101  e   102  f   103  g  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/* 104  h   105  i   106  j   107  k   108  l   109  m   110  n   111  o  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/* 112  p   113  q   114  r   115  s   116  t   117  u   118  v   119  w  */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
-/* 120  x   121  y   122  z   123  {   124  |   125  }   126  ~   127 del */
-        1    |   2    |   4    |   8    |   16   |   32   |   64   |   0, };
-
-#undef T
-
-enum state
-  { s_dead = 1 /* important that this is > 0 */
-
-  , s_start_req
-
-  , s_req_method
-  , s_req_spaces_before_url
-  , s_req_schema
-  , s_req_schema_slash
-  , s_req_schema_slash_slash
-  , s_req_server_start
-  , s_req_server
-  , s_req_server_with_at
-  , s_req_path
-  , s_req_query_string_start
-  , s_req_query_string
-  , s_req_fragment_start
-  , s_req_fragment
-  , s_req_http_start
-  , s_req_http_H
-  , s_req_http_HT
-  , s_req_http_HTT
-  , s_req_http_HTTP
-  , s_req_first_http_major
-  , s_req_http_major
-  , s_req_first_http_minor
-  , s_req_http_minor
-  , s_req_line_almost_done
-
-  , s_header_field_start
-  , s_header_field
-  , s_header_value_discard_ws
-  , s_header_value_discard_ws_almost_done
-  , s_header_value_discard_lws
-  , s_header_value_start
-  , s_header_value
-  , s_header_value_lws
-
-  , s_header_almost_done
-
-  , s_chunk_size_start
-  , s_chunk_size
-  , s_chunk_parameters
-  , s_chunk_size_almost_done
-
-  , s_headers_almost_done
-  , s_headers_done
-
-  /* Important: 's_headers_done' must be the last 'header' state. All
-   * states beyond this must be 'body' states. It is used for overflow
-   * checking. See the PARSING_HEADER() macro.
-   */
-
-  , s_chunk_data
-  , s_chunk_data_almost_done
-  , s_chunk_data_done
-
-  , s_body_identity
-  , s_body_identity_eof
-
-  , s_message_done
-  };
-
-
-#define PARSING_HEADER(state) (state <= s_headers_done)
-
-
-enum header_states
-  { h_general = 0
-  , h_C
-  , h_CO
-  , h_CON
-
-  , h_matching_connection
-  , h_matching_proxy_connection
-  , h_matching_content_length
-  , h_matching_transfer_encoding
-  , h_matching_upgrade
-
-  , h_connection
-  , h_content_length
-  , h_transfer_encoding
-  , h_upgrade
-
-  , h_matching_transfer_encoding_chunked
-  , h_matching_connection_token_start
-  , h_matching_connection_keep_alive
-  , h_matching_connection_close
-  , h_matching_connection_upgrade
-  , h_matching_connection_token
-
-  , h_transfer_encoding_chunked
-  , h_connection_keep_alive
-  , h_connection_close
-  , h_connection_upgrade
-  };
-
 enum http_host_state
   {
     s_http_host_dead = 1
@@ -387,54 +41,6 @@ enum http_host_state
   , s_http_host_port
 };
 
-/* Macros for character classes; depends on strict-mode  */
-#define CR                  '\r'
-#define LF                  '\n'
-#define LOWER(c)            (unsigned char)(c | 0x20)
-#define IS_ALPHA(c)         (LOWER(c) >= 'a' && LOWER(c) <= 'z')
-#define IS_NUM(c)           ((c) >= '0' && (c) <= '9')
-#define IS_ALPHANUM(c)      (IS_ALPHA(c) || IS_NUM(c))
-#define IS_HEX(c)           (IS_NUM(c) || (LOWER(c) >= 'a' && LOWER(c) <= 'f'))
-#define IS_MARK(c)          ((c) == '-' || (c) == '_' || (c) == '.' || \
-  (c) == '!' || (c) == '~' || (c) == '*' || (c) == '\'' || (c) == '(' || \
-  (c) == ')')
-#define IS_USERINFO_CHAR(c) (IS_ALPHANUM(c) || IS_MARK(c) || (c) == '%' || \
-  (c) == ';' || (c) == ':' || (c) == '&' || (c) == '=' || (c) == '+' || \
-  (c) == '$' || (c) == ',')
-
-#define STRICT_TOKEN(c)     (tokens[(unsigned char)c])
-
-#if HTTP_PARSER_STRICT
-#define TOKEN(c)            (tokens[(unsigned char)c])
-#define IS_URL_CHAR(c)      (BIT_AT(normal_url_char, (unsigned char)c))
-#define IS_HOST_CHAR(c)     (IS_ALPHANUM(c) || (c) == '.' || (c) == '-')
-#else
-#define TOKEN(c)            ((c == ' ') ? ' ' : tokens[(unsigned char)c])
-#define IS_URL_CHAR(c)                                                         \
-  (BIT_AT(normal_url_char, (unsigned char)c) || ((c) & 0x80))
-#define IS_HOST_CHAR(c)                                                        \
-  (IS_ALPHANUM(c) || (c) == '.' || (c) == '-' || (c) == '_')
-#endif
-
-
-#define start_state (s_start_req)
-
-
-#if HTTP_PARSER_STRICT
-# define STRICT_CHECK(cond)                                          \
-do {                                                                 \
-  if (cond) {                                                        \
-    SET_ERRNO(HPE_STRICT);                                           \
-    goto error;                                                      \
-  }                                                                  \
-} while (0)
-# define NEW_MESSAGE() (http_should_keep_alive(parser) ? start_state : s_dead)
-#else
-# define STRICT_CHECK(cond)
-# define NEW_MESSAGE() start_state
-#endif
-
-
 /* Map errno values to strings for human-readable output */
 #define HTTP_STRERROR_GEN(n, s) { "HPE_" #n, s },
 static struct {
@@ -445,1386 +51,657 @@ static struct {
 };
 #undef HTTP_STRERROR_GEN
 
-int http_message_needs_eof(const http_parser *parser);
+#define EXECUTE_NAME execute_incremental
+#define EXECUTE_HEADER_BLOCK 0
+#include "http_parser_engine.h"
 
-/* Our URL parser.
- *
- * This is designed to be shared by http_parser_execute() for URL validation,
- * hence it has a state transition + byte-for-byte interface. In addition, it
- * is meant to be embedded in http_parser_parse_url(), which does the dirty
- * work of turning state transitions URL components for its API.
- *
- * This function should only be invoked with non-space characters. It is
- * assumed that the caller cares about (and can detect) the transition between
- * URL and non-URL states by looking for these.
- */
-static enum state
-parse_url_char(enum state s, const char ch)
-{
-  if (ch == ' ' || ch == '\r' || ch == '\n') {
-    return s_dead;
-  }
-
-#if HTTP_PARSER_STRICT
-  if (ch == '\t' || ch == '\f') {
-    return s_dead;
-  }
+#if HTTP_PARSER_HEADER_BLOCK
+#define EXECUTE_NAME execute_header_block
+#define EXECUTE_HEADER_BLOCK 1
+#include "http_parser_engine.h"
 #endif
 
-  switch (s) {
-    case s_req_spaces_before_url:
-      /* Proxied requests are followed by scheme of an absolute URI (alpha).
-       * All methods except CONNECT are followed by '/' or '*'.
-       */
-
-      if (ch == '/' || ch == '*') {
-        return s_req_path;
-      }
-
-      if (IS_ALPHA(ch)) {
-        return s_req_schema;
-      }
-
-      break;
-
-    case s_req_schema:
-      if (IS_ALPHA(ch)) {
-        return s;
-      }
-
-      if (ch == ':') {
-        return s_req_schema_slash;
-      }
-
-      break;
-
-    case s_req_schema_slash:
-      if (ch == '/') {
-        return s_req_schema_slash_slash;
-      }
-
-      break;
-
-    case s_req_schema_slash_slash:
-      if (ch == '/') {
-        return s_req_server_start;
-      }
-
-      break;
-
-    case s_req_server_with_at:
-      if (ch == '@') {
-        return s_dead;
-      }
-
-    /* FALLTHROUGH */
-    case s_req_server_start:
-    case s_req_server:
-      if (ch == '/') {
-        return s_req_path;
-      }
-
-      if (ch == '?') {
-        return s_req_query_string_start;
-      }
-
-      if (ch == '@') {
-        return s_req_server_with_at;
-      }
-
-      if (IS_USERINFO_CHAR(ch) || ch == '[' || ch == ']') {
-        return s_req_server;
-      }
-
-      break;
-
-    case s_req_path:
-      if (IS_URL_CHAR(ch)) {
-        return s;
-      }
-
-      switch (ch) {
-        case '?':
-          return s_req_query_string_start;
-
-        case '#':
-          return s_req_fragment_start;
-      }
-
-      break;
-
-    case s_req_query_string_start:
-    case s_req_query_string:
-      if (IS_URL_CHAR(ch)) {
-        return s_req_query_string;
-      }
+/* The callbacks of http_parser_parse_request_headers(). They are resolved
+ * at compile time and store spans straight into the caller's array.
+ */
+struct header_array {
+  const char *url;
+  size_t url_len;
+  struct http_parser_header *headers;
+  size_t num_headers;
+  size_t max_headers;
+  int value_pending;
+  int done;
+};
 
-      switch (ch) {
-        case '?':
-          /* allow extra '?' in query string */
-          return s_req_query_string;
+#define HEADER_ARRAY_message_begin      0
+#define HEADER_ARRAY_url                1
+#define HEADER_ARRAY_status             0
+#define HEADER_ARRAY_header_field       2
+#define HEADER_ARRAY_header_value       3
+#define HEADER_ARRAY_headers_complete   4
+#define HEADER_ARRAY_body               0
+#define HEADER_ARRAY_message_complete   0
+#define HEADER_ARRAY_chunk_header       0
+#define HEADER_ARRAY_chunk_complete     0
+
+static inline int
+header_array_notify(struct header_array *array, int cb)
+{
+  if (cb == HEADER_ARRAY_headers_complete) {
+    array->done = 1;
+  }
+  return 0;
+}
 
-        case '#':
-          return s_req_fragment_start;
-      }
+static inline int
+header_array_data(http_parser *parser,
+                  struct header_array *array,
+                  int cb,
+                  const char *at,
+                  size_t len)
+{
+  struct http_parser_header *h;
 
+  switch (cb) {
+    case HEADER_ARRAY_url:
+      array->url = at;
+      array->url_len = len;
       break;
 
-    case s_req_fragment_start:
-      if (IS_URL_CHAR(ch)) {
-        return s_req_fragment;
-      }
-
-      switch (ch) {
-        case '?':
-          return s_req_fragment;
-
-        case '#':
-          return s;
+    case HEADER_ARRAY_header_field:
+    case HEADER_ARRAY_header_value:
+      if (cb == HEADER_ARRAY_header_value && array->value_pending) {
+        h = &array->headers[array->num_headers - 1];
+        h->value = at;
+        h->value_len = len;
+        array->value_pending = 0;
+        break;
       }
 
-      break;
-
-    case s_req_fragment:
-      if (IS_URL_CHAR(ch)) {
-        return s;
+      if (UNLIKELY(array->num_headers == array->max_headers)) {
+        SET_ERRNO(HPE_HEADER_OVERFLOW);
+        break;
       }
 
-      switch (ch) {
-        case '?':
-        case '#':
-          return s;
+      h = &array->headers[array->num_headers++];
+      if (cb == HEADER_ARRAY_header_field) {
+        /* No value until we see one; "Name:\r\n" has none */
+        h->name = at;
+        h->name_len = len;
+        h->value = at + len;
+        h->value_len = 0;
+        array->value_pending = 1;
+      } else {
+        /* Continuation of a folded header */
+        h->name = NULL;
+        h->name_len = 0;
+        h->value = at;
+        h->value_len = len;
       }
-
-      break;
-
-    default:
       break;
   }
 
-  /* We should never fall out of the switch above unless there's an error */
-  return s_dead;
+  return 0;
 }
 
+#define EXECUTE_NAME execute_header_array
+#define EXECUTE_HEADER_BLOCK 1
+#define EXECUTE_SETTINGS struct header_array
+#define HAS_CALLBACK(FOR) (HEADER_ARRAY_##FOR != 0)
+#define RUN_NOTIFY_CALLBACK(FOR)                                     \
+  header_array_notify(settings, HEADER_ARRAY_##FOR)
+#define RUN_DATA_CALLBACK(FOR, AT, LEN)                              \
+  header_array_data(parser, settings, HEADER_ARRAY_##FOR, AT, LEN)
+#include "http_parser_engine.h"
+
+#define EXECUTE_NAME execute_response
+#define EXECUTE_HEADER_BLOCK 0
+#define EXECUTE_RESPONSE 1
+#define EXECUTE_DETECT_NAME start_req_or_res
+#include "http_parser_engine.h"
+
 size_t http_parser_execute (http_parser *parser,
                             const http_parser_settings *settings,
                             const char *data,
                             size_t len)
 {
-  char c, ch;
-  int8_t unhex_val;
-  const char *p = data;
-  const char *header_field_mark = 0;
-  const char *header_value_mark = 0;
-  const char *url_mark = 0;
-  const char *body_mark = 0;
-  const char *status_mark = 0;
-  enum state p_state = (enum state) parser->state;
-
-  /* We're in an error state. Don't bother doing anything. */
-  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
-    return 0;
-  }
-
-  if (len == 0) {
-    switch (CURRENT_STATE()) {
-      case s_body_identity_eof:
-        /* Use of CALLBACK_NOTIFY() here would erroneously return 1 byte read if
-         * we got paused.
-         */
-        CALLBACK_NOTIFY_NOADVANCE(message_complete);
-        return 0;
-
-      case s_dead:
-      case s_start_req:
-        return 0;
-
-      default:
-        SET_ERRNO(HPE_INVALID_EOF_STATE);
-        return 1;
+  size_t nparsed = 0;
+
+  if (UNLIKELY(parser->type != HTTP_REQUEST)) {
+    if (parser->type == HTTP_BOTH) {
+      nparsed = start_req_or_res(parser, settings, data, len);
+      if (parser->type == HTTP_BOTH ||
+          HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+        return nparsed;
+      }
     }
-  }
-
 
-  if (CURRENT_STATE() == s_header_field)
-    header_field_mark = data;
-  if (CURRENT_STATE() == s_header_value)
-    header_value_mark = data;
-  switch (CURRENT_STATE()) {
-  case s_req_path:
-  case s_req_schema:
-  case s_req_schema_slash:
-  case s_req_schema_slash_slash:
-  case s_req_server_start:
-  case s_req_server:
-  case s_req_server_with_at:
-  case s_req_query_string_start:
-  case s_req_query_string:
-  case s_req_fragment_start:
-  case s_req_fragment:
-    url_mark = data;
-    break;
-  default:
-    break;
+    if (parser->type == HTTP_RESPONSE) {
+      return nparsed + execute_response(parser, settings,
+                                        data + nparsed, len - nparsed);
+    }
   }
 
-  for (p=data; p != data + len; p++) {
-    ch = *p;
-
-    if (PARSING_HEADER(CURRENT_STATE()))
-      COUNT_HEADER_SIZE(1);
-
-reexecute:
-    switch (CURRENT_STATE()) {
-
-      case s_dead:
-        /* this state is used after a 'Connection: close' message
-         * the parser will error out if it reads another message
-         */
-        if (LIKELY(ch == CR || ch == LF))
-          break;
-
-        SET_ERRNO(HPE_CLOSED_CONNECTION);
-        goto error;
-
-      case s_start_req:
-      {
-        if (ch == CR || ch == LF)
-          break;
-        parser->flags = 0;
-        parser->content_length = ULLONG_MAX;
-
-        if (UNLIKELY(!IS_ALPHA(ch))) {
-          SET_ERRNO(HPE_INVALID_METHOD);
-          goto error;
-        }
-
-        parser->method = (enum http_method) 0;
-        parser->index = 1;
-        switch (ch) {
-          case 'C': parser->method = HTTP_CONNECT; /* or COPY, CHECKOUT */ break;
-          case 'D': parser->method = HTTP_DELETE; break;
-          case 'G': parser->method = HTTP_GET; break;
-          case 'H': parser->method = HTTP_HEAD; break;
-          case 'L': parser->method = HTTP_LOCK; break;
-          case 'M': parser->method = HTTP_MKCOL; /* or MOVE, MKACTIVITY, MERGE, M-SEARCH, MKCALENDAR */ break;
-          case 'N': parser->method = HTTP_NOTIFY; break;
-          case 'O': parser->method = HTTP_OPTIONS; break;
-          case 'P': parser->method = HTTP_POST;
-            /* or PROPFIND|PROPPATCH|PUT|PATCH|PURGE */
-            break;
-          case 'R': parser->method = HTTP_REPORT; break;
-          case 'S': parser->method = HTTP_SUBSCRIBE; /* or SEARCH */ break;
-          case 'T': parser->method = HTTP_TRACE; break;
-          case 'U': parser->method = HTTP_UNLOCK; /* or UNSUBSCRIBE */ break;
-          default:
-            SET_ERRNO(HPE_INVALID_METHOD);
-            goto error;
-        }
-        UPDATE_STATE(s_req_method);
-
-        CALLBACK_NOTIFY(message_begin);
-
-        break;
-      }
-
-      case s_req_method:
-      {
-        const char *matcher;
-        if (UNLIKELY(ch == '\0')) {
-          SET_ERRNO(HPE_INVALID_METHOD);
-          goto error;
-        }
-
-        matcher = method_strings[parser->method];
-        if (ch == ' ' && matcher[parser->index] == '\0') {
-          UPDATE_STATE(s_req_spaces_before_url);
-        } else if (ch == matcher[parser->index]) {
-          ; /* nada */
-        } else if (parser->method == HTTP_CONNECT) {
-          if (parser->index == 1 && ch == 'H') {
-            parser->method = HTTP_CHECKOUT;
-          } else if (parser->index == 2  && ch == 'P') {
-            parser->method = HTTP_COPY;
-          } else {
-            SET_ERRNO(HPE_INVALID_METHOD);
-            goto error;
-          }
-        } else if (parser->method == HTTP_MKCOL) {
-          if (parser->index == 1 && ch == 'O') {
-            parser->method = HTTP_MOVE;
-          } else if (parser->index == 1 && ch == 'E') {
-            parser->method = HTTP_MERGE;
-          } else if (parser->index == 1 && ch == '-') {
-            parser->method = HTTP_MSEARCH;
-          } else if (parser->index == 2 && ch == 'A') {
-            parser->method = HTTP_MKACTIVITY;
-          } else if (parser->index == 3 && ch == 'A') {
-            parser->method = HTTP_MKCALENDAR;
-          } else {
-            SET_ERRNO(HPE_INVALID_METHOD);
-            goto error;
-          }
-        } else if (parser->method == HTTP_SUBSCRIBE) {
-          if (parser->index == 1 && ch == 'E') {
-            parser->method = HTTP_SEARCH;
-          } else {
-            SET_ERRNO(HPE_INVALID_METHOD);
-            goto error;
-          }
-        } else if (parser->index == 1 && parser->method == HTTP_POST) {
-          if (ch == 'R') {
-            parser->method = HTTP_PROPFIND; /* or HTTP_PROPPATCH */
-          } else if (ch == 'U') {
-            parser->method = HTTP_PUT; /* or HTTP_PURGE */
-          } else if (ch == 'A') {
-            parser->method = HTTP_PATCH;
-          } else {
-            SET_ERRNO(HPE_INVALID_METHOD);
-            goto error;
-          }
-        } else if (parser->index == 2) {
-          if (parser->method == HTTP_PUT) {
-            if (ch == 'R') {
-              parser->method = HTTP_PURGE;
-            } else {
-              SET_ERRNO(HPE_INVALID_METHOD);
-              goto error;
-            }
-          } else if (parser->method == HTTP_UNLOCK) {
-            if (ch == 'S') {
-              parser->method = HTTP_UNSUBSCRIBE;
-            } else {
-              SET_ERRNO(HPE_INVALID_METHOD);
-              goto error;
-            }
-          } else {
-            SET_ERRNO(HPE_INVALID_METHOD);
-            goto error;
-          }
-        } else if (parser->index == 4 && parser->method == HTTP_PROPFIND && ch == 'P') {
-          parser->method = HTTP_PROPPATCH;
-        } else {
-          SET_ERRNO(HPE_INVALID_METHOD);
-          goto error;
-        }
-
-        ++parser->index;
-        break;
-      }
-
-      case s_req_spaces_before_url:
-      {
-        if (ch == ' ') break;
-
-        MARK(url);
-        if (parser->method == HTTP_CONNECT) {
-          UPDATE_STATE(s_req_server_start);
-        }
-
-        UPDATE_STATE(parse_url_char(CURRENT_STATE(), ch));
-        if (UNLIKELY(CURRENT_STATE() == s_dead)) {
-          SET_ERRNO(HPE_INVALID_URL);
-          goto error;
-        }
-
-        break;
-      }
-
-      case s_req_schema:
-      case s_req_schema_slash:
-      case s_req_schema_slash_slash:
-      case s_req_server_start:
-      {
-        switch (ch) {
-          /* No whitespace allowed here */
-          case ' ':
-          case CR:
-          case LF:
-            SET_ERRNO(HPE_INVALID_URL);
-            goto error;
-          default:
-            UPDATE_STATE(parse_url_char(CURRENT_STATE(), ch));
-            if (UNLIKELY(CURRENT_STATE() == s_dead)) {
-              SET_ERRNO(HPE_INVALID_URL);
-              goto error;
-            }
-        }
-
-        break;
-      }
-
-      case s_req_server:
-      case s_req_server_with_at:
-      case s_req_path:
-      case s_req_query_string_start:
-      case s_req_query_string:
-      case s_req_fragment_start:
-      case s_req_fragment:
-      {
-        switch (ch) {
-          case ' ':
-            UPDATE_STATE(s_req_http_start);
-            CALLBACK_DATA(url);
-            break;
-          case CR:
-          case LF:
-            parser->http_major = 0;
-            parser->http_minor = 9;
-            UPDATE_STATE((ch == CR) ?
-              s_req_line_almost_done :
-              s_header_field_start);
-            CALLBACK_DATA(url);
-            break;
-          default:
-            UPDATE_STATE(parse_url_char(CURRENT_STATE(), ch));
-            if (UNLIKELY(CURRENT_STATE() == s_dead)) {
-              SET_ERRNO(HPE_INVALID_URL);
-              goto error;
-            }
-        }
-        break;
-      }
-
-      case s_req_http_start:
-        switch (ch) {
-          case 'H':
-            UPDATE_STATE(s_req_http_H);
-            break;
-          case ' ':
-            break;
-          default:
-            SET_ERRNO(HPE_INVALID_CONSTANT);
-            goto error;
-        }
-        break;
-
-      case s_req_http_H:
-        STRICT_CHECK(ch != 'T');
-        UPDATE_STATE(s_req_http_HT);
-        break;
-
-      case s_req_http_HT:
-        STRICT_CHECK(ch != 'T');
-        UPDATE_STATE(s_req_http_HTT);
-        break;
-
-      case s_req_http_HTT:
-        STRICT_CHECK(ch != 'P');
-        UPDATE_STATE(s_req_http_HTTP);
-        break;
-
-      case s_req_http_HTTP:
-        STRICT_CHECK(ch != '/');
-        UPDATE_STATE(s_req_first_http_major);
-        break;
-
-      /* first digit of major HTTP version */
-      case s_req_first_http_major:
-        if (UNLIKELY(ch < '1' || ch > '9')) {
-          SET_ERRNO(HPE_INVALID_VERSION);
-          goto error;
-        }
-
-        parser->http_major = ch - '0';
-        UPDATE_STATE(s_req_http_major);
-        break;
-
-      /* major HTTP version or dot */
-      case s_req_http_major:
-      {
-        if (ch == '.') {
-          UPDATE_STATE(s_req_first_http_minor);
-          break;
-        }
-
-        if (UNLIKELY(!IS_NUM(ch))) {
-          SET_ERRNO(HPE_INVALID_VERSION);
-          goto error;
-        }
-
-        parser->http_major *= 10;
-        parser->http_major += ch - '0';
-
-        if (UNLIKELY(parser->http_major > 999)) {
-          SET_ERRNO(HPE_INVALID_VERSION);
-          goto error;
-        }
-
-        break;
-      }
-
-      /* first digit of minor HTTP version */
-      case s_req_first_http_minor:
-        if (UNLIKELY(!IS_NUM(ch))) {
-          SET_ERRNO(HPE_INVALID_VERSION);
-          goto error;
-        }
-
-        parser->http_minor = ch - '0';
-        UPDATE_STATE(s_req_http_minor);
-        break;
-
-      /* minor HTTP version or end of request line */
-      case s_req_http_minor:
-      {
-        if (ch == CR) {
-          UPDATE_STATE(s_req_line_almost_done);
-          break;
-        }
-
-        if (ch == LF) {
-          UPDATE_STATE(s_header_field_start);
-          break;
-        }
-
-        /* XXX allow spaces after digit? */
-
-        if (UNLIKELY(!IS_NUM(ch))) {
-          SET_ERRNO(HPE_INVALID_VERSION);
-          goto error;
-        }
-
-        parser->http_minor *= 10;
-        parser->http_minor += ch - '0';
-
-        if (UNLIKELY(parser->http_minor > 999)) {
-          SET_ERRNO(HPE_INVALID_VERSION);
-          goto error;
-        }
-
-        break;
-      }
-
-      /* end of request line */
-      case s_req_line_almost_done:
-      {
-        if (UNLIKELY(ch != LF)) {
-          SET_ERRNO(HPE_LF_EXPECTED);
-          goto error;
-        }
-
-        UPDATE_STATE(s_header_field_start);
-        break;
-      }
-
-      case s_header_field_start:
-      {
-        if (ch == CR) {
-          UPDATE_STATE(s_headers_almost_done);
-          break;
-        }
-
-        if (ch == LF) {
-          /* they might be just sending \n instead of \r\n so this would be
-           * the second \n to denote the end of headers*/
-          UPDATE_STATE(s_headers_almost_done);
-          REEXECUTE();
-        }
-
-        c = TOKEN(ch);
-
-        if (UNLIKELY(!c)) {
-          SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
-          goto error;
-        }
-
-        MARK(header_field);
-
-        parser->index = 0;
-        UPDATE_STATE(s_header_field);
-
-        switch (c) {
-          case 'c':
-            parser->header_state = h_C;
-            break;
-
-          case 'p':
-            parser->header_state = h_matching_proxy_connection;
-            break;
-
-          case 't':
-            parser->header_state = h_matching_transfer_encoding;
-            break;
-
-          case 'u':
-            parser->header_state = h_matching_upgrade;
-            break;
-
-          default:
-            parser->header_state = h_general;
-            break;
-        }
-        break;
-      }
-
-      case s_header_field:
-      {
-        const char* start = p;
-        for (; p != data + len; p++) {
-          ch = *p;
-          c = TOKEN(ch);
-
-          if (!c)
-            break;
-
-          switch (parser->header_state) {
-            case h_general:
-              break;
-
-            case h_C:
-              parser->index++;
-              parser->header_state = (c == 'o' ? h_CO : h_general);
-              break;
-
-            case h_CO:
-              parser->index++;
-              parser->header_state = (c == 'n' ? h_CON : h_general);
-              break;
-
-            case h_CON:
-              parser->index++;
-              switch (c) {
-                case 'n':
-                  parser->header_state = h_matching_connection;
-                  break;
-                case 't':
-                  parser->header_state = h_matching_content_length;
-                  break;
-                default:
-                  parser->header_state = h_general;
-                  break;
-              }
-              break;
-
-            /* connection */
-
-            case h_matching_connection:
-              parser->index++;
-              if (parser->index > sizeof(CONNECTION)-1
-                  || c != CONNECTION[parser->index]) {
-                parser->header_state = h_general;
-              } else if (parser->index == sizeof(CONNECTION)-2) {
-                parser->header_state = h_connection;
-              }
-              break;
-
-            /* proxy-connection */
-
-            case h_matching_proxy_connection:
-              parser->index++;
-              if (parser->index > sizeof(PROXY_CONNECTION)-1
-                  || c != PROXY_CONNECTION[parser->index]) {
-                parser->header_state = h_general;
-              } else if (parser->index == sizeof(PROXY_CONNECTION)-2) {
-                parser->header_state = h_connection;
-              }
-              break;
-
-            /* content-length */
-
-            case h_matching_content_length:
-              parser->index++;
-              if (parser->index > sizeof(CONTENT_LENGTH)-1
-                  || c != CONTENT_LENGTH[parser->index]) {
-                parser->header_state = h_general;
-              } else if (parser->index == sizeof(CONTENT_LENGTH)-2) {
-                parser->header_state = h_content_length;
-              }
-              break;
-
-            /* transfer-encoding */
-
-            case h_matching_transfer_encoding:
-              parser->index++;
-              if (parser->index > sizeof(TRANSFER_ENCODING)-1
-                  || c != TRANSFER_ENCODING[parser->index]) {
-                parser->header_state = h_general;
-              } else if (parser->index == sizeof(TRANSFER_ENCODING)-2) {
-                parser->header_state = h_transfer_encoding;
-              }
-              break;
-
-            /* upgrade */
-
-            case h_matching_upgrade:
-              parser->index++;
-              if (parser->index > sizeof(UPGRADE)-1
-                  || c != UPGRADE[parser->index]) {
-                parser->header_state = h_general;
-              } else if (parser->index == sizeof(UPGRADE)-2) {
-                parser->header_state = h_upgrade;
-              }
-              break;
-
-            case h_connection:
-            case h_content_length:
-            case h_transfer_encoding:
-            case h_upgrade:
-              if (ch != ' ') parser->header_state = h_general;
-              break;
-
-            default:
-              assert(0 && "Unknown header_state");
-              break;
-          }
-        }
-
-        COUNT_HEADER_SIZE(p - start);
-
-        if (p == data + len) {
-          --p;
-          break;
-        }
-
-        if (ch == ':') {
-          UPDATE_STATE(s_header_value_discard_ws);
-          CALLBACK_DATA(header_field);
-          break;
-        }
-
-        SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
-        goto error;
-      }
-
-      case s_header_value_discard_ws:
-        if (ch == ' ' || ch == '\t') break;
-
-        if (ch == CR) {
-          UPDATE_STATE(s_header_value_discard_ws_almost_done);
-          break;
-        }
-
-        if (ch == LF) {
-          UPDATE_STATE(s_header_value_discard_lws);
-          break;
-        }
-
-        /* FALLTHROUGH */
-
-      case s_header_value_start:
-      {
-        MARK(header_value);
-
-        UPDATE_STATE(s_header_value);
-        parser->index = 0;
-
-        c = LOWER(ch);
-
-        switch (parser->header_state) {
-          case h_upgrade:
-            parser->flags |= F_UPGRADE;
-            parser->header_state = h_general;
-            break;
-
-          case h_transfer_encoding:
-            /* looking for 'Transfer-Encoding: chunked' */
-            if ('c' == c) {
-              parser->header_state = h_matching_transfer_encoding_chunked;
-            } else {
-              parser->header_state = h_general;
-            }
-            break;
-
-          case h_content_length:
-            if (UNLIKELY(!IS_NUM(ch))) {
-              SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
-              goto error;
-            }
-
-            parser->content_length = ch - '0';
-            break;
-
-          case h_connection:
-            /* looking for 'Connection: keep-alive' */
-            if (c == 'k') {
-              parser->header_state = h_matching_connection_keep_alive;
-            /* looking for 'Connection: close' */
-            } else if (c == 'c') {
-              parser->header_state = h_matching_connection_close;
-            } else if (c == 'u') {
-              parser->header_state = h_matching_connection_upgrade;
-            } else {
-              parser->header_state = h_matching_connection_token;
-            }
-            break;
-
-          /* Multi-value `Connection` header */
-          case h_matching_connection_token_start:
-            break;
-
-          default:
-            parser->header_state = h_general;
-            break;
-        }
-        break;
+#if HTTP_PARSER_HEADER_BLOCK
+  /* Start every request with the header block engine, which is the same
+   * state machine minus the header size accounting. That's safe as long as
+   * the buffer is too short to overflow the limit. A head that is cut short
+   * by the end of the buffer is picked up by the incremental engine on the
+   * next call.
+   */
+  while (parser->state == s_start_req &&
+         HTTP_PARSER_ERRNO(parser) == HPE_OK &&
+         nparsed < len &&
+         IS_ALPHA(data[nparsed])) {
+    size_t limit = MIN(len - nparsed, header_room(parser));
+    uint32_t nread = parser->nread;
+    size_t n;
+
+    n = execute_header_block(parser, settings, data + nparsed, limit);
+    nparsed += n;
+
+    /* Stopped inside the head; charge what it read */
+    if (PARSING_HEADER(parser->state) &&
+        parser->state != s_start_req &&
+        parser->state != s_dead &&
+        parser->state != s_chunk_size_start) {
+      parser->nread = nread + n;
+      if (HTTP_PARSER_ERRNO(parser) != HPE_OK || nparsed == len) {
+        return nparsed;
       }
+      break;
+    }
 
-      case s_header_value:
-      {
-        const char* start = p;
-        enum header_states h_state = (enum header_states) parser->header_state;
-        for (; p != data + len; p++) {
-          ch = *p;
-          if (ch == CR) {
-            UPDATE_STATE(s_header_almost_done);
-            parser->header_state = h_state;
-            CALLBACK_DATA(header_value);
-            break;
-          }
-
-          if (ch == LF) {
-            UPDATE_STATE(s_header_almost_done);
-            COUNT_HEADER_SIZE(p - start);
-            parser->header_state = h_state;
-            CALLBACK_DATA_NOADVANCE(header_value);
-            REEXECUTE();
-          }
-
-          c = LOWER(ch);
-
-          switch (h_state) {
-            case h_general:
-            {
-              const char* p_cr;
-              const char* p_lf;
-              size_t limit = data + len - p;
-
-              limit = MIN(limit, HTTP_MAX_HEADER_SIZE);
-
-              p_cr = (const char*) memchr(p, CR, limit);
-              p_lf = (const char*) memchr(p, LF, limit);
-              if (p_cr != NULL) {
-                if (p_lf != NULL && p_cr >= p_lf)
-                  p = p_lf;
-                else
-                  p = p_cr;
-              } else if (UNLIKELY(p_lf != NULL)) {
-                p = p_lf;
-              } else {
-                p = data + len;
-              }
-              --p;
-
-              break;
-            }
-
-            case h_connection:
-            case h_transfer_encoding:
-              assert(0 && "Shouldn't get here.");
-              break;
-
-            case h_content_length:
-            {
-              uint64_t t;
-
-              if (ch == ' ') break;
-
-              if (UNLIKELY(!IS_NUM(ch))) {
-                SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
-                parser->header_state = h_state;
-                goto error;
-              }
-
-              t = parser->content_length;
-              t *= 10;
-              t += ch - '0';
-
-              /* Overflow? Test against a conservative limit for simplicity. */
-              if (UNLIKELY((ULLONG_MAX - 10) / 10 < parser->content_length)) {
-                SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
-                parser->header_state = h_state;
-                goto error;
-              }
-
-              parser->content_length = t;
-              break;
-            }
-
-            /* Transfer-Encoding: chunked */
-            case h_matching_transfer_encoding_chunked:
-              parser->index++;
-              if (parser->index > sizeof(CHUNKED)-1
-                  || c != CHUNKED[parser->index]) {
-                h_state = h_general;
-              } else if (parser->index == sizeof(CHUNKED)-2) {
-                h_state = h_transfer_encoding_chunked;
-              }
-              break;
-
-            case h_matching_connection_token_start:
-              /* looking for 'Connection: keep-alive' */
-              if (c == 'k') {
-                h_state = h_matching_connection_keep_alive;
-              /* looking for 'Connection: close' */
-              } else if (c == 'c') {
-                h_state = h_matching_connection_close;
-              } else if (c == 'u') {
-                h_state = h_matching_connection_upgrade;
-              } else if (STRICT_TOKEN(c)) {
-                h_state = h_matching_connection_token;
-              } else if (c == ' ' || c == '\t') {
-                /* Skip lws */
-              } else {
-                h_state = h_general;
-              }
-              break;
-
-            /* looking for 'Connection: keep-alive' */
-            case h_matching_connection_keep_alive:
-              parser->index++;
-              if (parser->index > sizeof(KEEP_ALIVE)-1
-                  || c != KEEP_ALIVE[parser->index]) {
-                h_state = h_matching_connection_token;
-              } else if (parser->index == sizeof(KEEP_ALIVE)-2) {
-                h_state = h_connection_keep_alive;
-              }
-              break;
-
-            /* looking for 'Connection: close' */
-            case h_matching_connection_close:
-              parser->index++;
-              if (parser->index > sizeof(CLOSE)-1 || c != CLOSE[parser->index]) {
-                h_state = h_matching_connection_token;
-              } else if (parser->index == sizeof(CLOSE)-2) {
-                h_state = h_connection_close;
-              }
-              break;
-
-            /* looking for 'Connection: upgrade' */
-            case h_matching_connection_upgrade:
-              parser->index++;
-              if (parser->index > sizeof(UPGRADE) - 1 ||
-                  c != UPGRADE[parser->index]) {
-                h_state = h_matching_connection_token;
-              } else if (parser->index == sizeof(UPGRADE)-2) {
-                h_state = h_connection_upgrade;
-              }
-              break;
-
-            case h_matching_connection_token:
-              if (ch == ',') {
-                h_state = h_matching_connection_token_start;
-                parser->index = 0;
-              }
-              break;
-
-            case h_transfer_encoding_chunked:
-              if (ch != ' ') h_state = h_general;
-              break;
-
-            case h_connection_keep_alive:
-            case h_connection_close:
-            case h_connection_upgrade:
-              if (ch == ',') {
-                if (h_state == h_connection_keep_alive) {
-                  parser->flags |= F_CONNECTION_KEEP_ALIVE;
-                } else if (h_state == h_connection_close) {
-                  parser->flags |= F_CONNECTION_CLOSE;
-                } else if (h_state == h_connection_upgrade) {
-                  parser->flags |= F_CONNECTION_UPGRADE;
-                }
-                h_state = h_matching_connection_token_start;
-                parser->index = 0;
-              } else if (ch != ' ') {
-                h_state = h_matching_connection_token;
-              }
-              break;
-
-            default:
-              UPDATE_STATE(s_header_value);
-              h_state = h_general;
-              break;
-          }
-        }
-        parser->header_state = h_state;
+    if (HTTP_PARSER_ERRNO(parser) != HPE_OK || nparsed == len) {
+      return nparsed;
+    }
 
-        COUNT_HEADER_SIZE(p - start);
+    /* Upgrade without a body; what follows is another protocol */
+    if (parser->upgrade &&
+        (parser->state == s_start_req || parser->state == s_dead)) {
+      return nparsed;
+    }
+  }
+#endif
 
-        if (p == data + len)
-          --p;
-        break;
-      }
+  return nparsed + execute_incremental(parser, settings,
+                                       data + nparsed, len - nparsed);
+}
 
-      case s_header_almost_done:
-      {
-        STRICT_CHECK(ch != LF);
 
-        UPDATE_STATE(s_header_value_lws);
-        break;
+void
+http_parser_execute_batch (http_parser *const parsers[],
+                           const http_parser_settings *settings,
+                           const char *const data[],
+                           const size_t lens[],
+                           size_t n,
+                           size_t nparsed[])
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    /* One connection ahead is enough; parsing a message takes longer than
+     * the loads
+     */
+    if (i + 1 < n) {
+      PREFETCH(parsers[i + 1]);
+      PREFETCH(data[i + 1]);
+      if (lens[i + 1] > 64) {
+        PREFETCH(data[i + 1] + 64);
       }
+    }
 
-      case s_header_value_lws:
-      {
-        if (ch == ' ' || ch == '\t') {
-          UPDATE_STATE(s_header_value_start);
-          REEXECUTE();
-        }
-
-        /* finished the header */
-        switch (parser->header_state) {
-          case h_connection_keep_alive:
-            parser->flags |= F_CONNECTION_KEEP_ALIVE;
-            break;
-          case h_connection_close:
-            parser->flags |= F_CONNECTION_CLOSE;
-            break;
-          case h_transfer_encoding_chunked:
-            parser->flags |= F_CHUNKED;
-            break;
-          case h_connection_upgrade:
-            parser->flags |= F_CONNECTION_UPGRADE;
-            break;
-          default:
-            break;
-        }
-
-        UPDATE_STATE(s_header_field_start);
-        REEXECUTE();
-      }
+    nparsed[i] = http_parser_execute(parsers[i], settings, data[i], lens[i]);
+  }
+}
 
-      case s_header_value_discard_ws_almost_done:
-      {
-        STRICT_CHECK(ch != LF);
-        UPDATE_STATE(s_header_value_discard_lws);
-        break;
-      }
 
-      case s_header_value_discard_lws:
-      {
-        if (ch == ' ' || ch == '\t') {
-          UPDATE_STATE(s_header_value_discard_ws);
-          break;
-        } else {
-          switch (parser->header_state) {
-            case h_connection_keep_alive:
-              parser->flags |= F_CONNECTION_KEEP_ALIVE;
-              break;
-            case h_connection_close:
-              parser->flags |= F_CONNECTION_CLOSE;
-              break;
-            case h_connection_upgrade:
-              parser->flags |= F_CONNECTION_UPGRADE;
-              break;
-            case h_transfer_encoding_chunked:
-              parser->flags |= F_CHUNKED;
-              break;
-            default:
-              break;
-          }
-
-          /* header value was empty */
-          MARK(header_value);
-          UPDATE_STATE(s_header_field_start);
-          CALLBACK_DATA_NOADVANCE(header_value);
-          REEXECUTE();
-        }
-      }
+#if !defined(_WIN32)
+size_t
+http_parser_execute_iov (http_parser *parser,
+                         const http_parser_settings *settings,
+                         const struct iovec *iov,
+                         int iovcnt,
+                         int *segment,
+                         size_t *offset)
+{
+  size_t nparsed = 0;
+  int i;
 
-      case s_headers_almost_done:
-      {
-        STRICT_CHECK(ch != LF);
+  if (iovcnt == 0) {
+    *segment = 0;
+    *offset = 0;
+    return http_parser_execute(parser, settings, NULL, 0);
+  }
 
-        if (parser->flags & F_TRAILING) {
-          /* End of a chunked request */
-          UPDATE_STATE(s_message_done);
-          CALLBACK_NOTIFY_NOADVANCE(chunk_complete);
-          REEXECUTE();
-        }
+  for (i = 0; i < iovcnt; i++) {
+    const char *data = (const char *) iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+    size_t n;
 
-        UPDATE_STATE(s_headers_done);
-
-        /* Set this here so that on_headers_complete() callbacks can see it */
-        parser->upgrade =
-          ((parser->flags & (F_UPGRADE | F_CONNECTION_UPGRADE)) ==
-           (F_UPGRADE | F_CONNECTION_UPGRADE) ||
-           parser->method == HTTP_CONNECT);
-
-        /* Here we call the headers_complete callback. This is somewhat
-         * different than other callbacks because if the user returns 1, we
-         * will interpret that as saying that this message has no body. This
-         * is needed for the annoying case of recieving a response to a HEAD
-         * request.
-         *
-         * We'd like to use CALLBACK_NOTIFY_NOADVANCE() here but we cannot, so
-         * we have to simulate it by handling a change in errno below.
-         */
-        if (settings->on_headers_complete) {
-          switch (settings->on_headers_complete(parser)) {
-            case 0:
-              break;
-
-            case 1:
-              parser->flags |= F_SKIPBODY;
-              break;
-
-            default:
-              SET_ERRNO(HPE_CB_headers_complete);
-              RETURN(p - data); /* Error */
-          }
-        }
+    if (len == 0) {
+      continue;       /* not EOF */
+    }
 
-        if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
-          RETURN(p - data);
-        }
+    if (i + 1 < iovcnt) {
+      PREFETCH(iov[i + 1].iov_base);
+    }
 
-        REEXECUTE();
-      }
+    n = http_parser_execute(parser, settings, data, len);
+    nparsed += n;
 
-      case s_headers_done:
-      {
-        STRICT_CHECK(ch != LF);
+    if (n != len) {
+      *segment = i;
+      *offset = n;
+      return nparsed;
+    }
 
-        parser->nread = 0;
+    /* Stopped at the end of the segment; the rest isn't for the parser */
+    if (HTTP_PARSER_ERRNO(parser) != HPE_OK ||
+        (parser->upgrade && (parser->state == s_start_req ||
+                             parser->state == s_start_res ||
+                             parser->state == s_dead))) {
+      break;
+    }
+  }
 
-        int hasBody = parser->flags & F_CHUNKED ||
-          (parser->content_length > 0 && parser->content_length != ULLONG_MAX);
-        if (parser->upgrade && (parser->method == HTTP_CONNECT ||
-                                (parser->flags & F_SKIPBODY) || !hasBody)) {
-          /* Exit, the rest of the message is in a different protocol. */
-          UPDATE_STATE(NEW_MESSAGE());
-          CALLBACK_NOTIFY(message_complete);
-          RETURN((p - data) + 1);
-        }
+  *segment = i == iovcnt ? iovcnt : i + 1;
+  *offset = 0;
+  return nparsed;
+}
+#endif
 
-        if (parser->flags & F_SKIPBODY) {
-          UPDATE_STATE(NEW_MESSAGE());
-          CALLBACK_NOTIFY(message_complete);
-        } else if (parser->flags & F_CHUNKED) {
-          /* chunked encoding - ignore Content-Length header */
-          UPDATE_STATE(s_chunk_size_start);
-        } else {
-          if (parser->content_length == 0) {
-            /* Content-Length header given but zero: Content-Length: 0\r\n */
-            UPDATE_STATE(NEW_MESSAGE());
-            CALLBACK_NOTIFY(message_complete);
-          } else if (parser->content_length != ULLONG_MAX) {
-            /* Content-Length header given and non-zero */
-            UPDATE_STATE(s_body_identity);
-          } else {
-            if (!http_message_needs_eof(parser)) {
-              /* Assume content-length 0 - read the next */
-              UPDATE_STATE(NEW_MESSAGE());
-              CALLBACK_NOTIFY(message_complete);
-            } else {
-              /* Read body until EOF */
-              UPDATE_STATE(s_body_identity_eof);
-            }
-          }
-        }
 
-        break;
-      }
+/* http_parser_execute_timed() puts a timed_context in parser->data for the
+ * duration of the call. Each timed_on_*() callback swaps the user's data
+ * back in, runs and times the real callback, and swaps it out again.
+ */
+struct timed_context {
+  const http_parser_settings *settings;
+  struct http_parser_timing *timing;
+  void *data;
+};
 
-      case s_body_identity:
-      {
-        uint64_t to_read = MIN(parser->content_length,
-                               (uint64_t) ((data + len) - p));
-
-        assert(parser->content_length != 0
-            && parser->content_length != ULLONG_MAX);
-
-        /* The difference between advancing content_length and p is because
-         * the latter will automaticaly advance on the next loop iteration.
-         * Further, if content_length ends up at 0, we want to see the last
-         * byte again for our message complete callback.
-         */
-        MARK(body);
-        parser->content_length -= to_read;
-        p += to_read - 1;
-
-        if (parser->content_length == 0) {
-          UPDATE_STATE(s_message_done);
-
-          /* Mimic CALLBACK_DATA_NOADVANCE() but with one extra byte.
-           *
-           * The alternative to doing this is to wait for the next byte to
-           * trigger the data callback, just as in every other case. The
-           * problem with this is that this makes it difficult for the test
-           * harness to distinguish between complete-on-EOF and
-           * complete-on-length. It's not clear that this distinction is
-           * important for applications, but let's keep it for now.
-           */
-          CALLBACK_DATA_(body, p - body_mark + 1, p - data);
-          REEXECUTE();
-        }
+#define TIMED_CALLBACK(FOR, PARAMS, ARGS)                            \
+static int                                                           \
+timed_on_##FOR PARAMS                                                \
+{                                                                    \
+  struct timed_context *ctx = (struct timed_context *) parser->data; \
+  struct http_parser_timing *timing = ctx->timing;                   \
+  int cb = HPE_CB_##FOR - HPE_CB_message_begin;                      \
+  uint64_t start, time;                                              \
+  int rv;                                                            \
+                                                                     \
+  parser->data = ctx->data;                                          \
+  start = timing->clock();                                           \
+  rv = ctx->settings->on_##FOR ARGS;                                 \
+  time = timing->clock() - start;                                    \
+  ctx->data = parser->data;                                          \
+  parser->data = ctx;                                                \
+                                                                     \
+  timing->callback_time[cb] += time;                                 \
+  timing->callback_calls[cb]++;                                      \
+  timing->callbacks += time;                                         \
+  return rv;                                                         \
+}
 
-        break;
-      }
+#define TIMED_NOTIFY(FOR)                                            \
+  TIMED_CALLBACK(FOR, (http_parser *parser), (parser))
+#define TIMED_DATA(FOR)                                              \
+  TIMED_CALLBACK(FOR,                                                \
+                 (http_parser *parser, const char *at, size_t length), \
+                 (parser, at, length))
+
+TIMED_NOTIFY(message_begin)
+TIMED_DATA(url)
+TIMED_DATA(status)
+TIMED_DATA(header_field)
+TIMED_DATA(header_value)
+TIMED_NOTIFY(headers_complete)
+TIMED_DATA(body)
+TIMED_NOTIFY(message_complete)
+TIMED_NOTIFY(chunk_header)
+TIMED_NOTIFY(chunk_complete)
+
+#undef TIMED_DATA
+#undef TIMED_NOTIFY
+#undef TIMED_CALLBACK
+
+size_t
+http_parser_execute_timed (http_parser *parser,
+                           const http_parser_settings *settings,
+                           const char *data,
+                           size_t len,
+                           struct http_parser_timing *timing)
+{
+  http_parser_settings timed;
+  struct timed_context ctx;
+  uint64_t start, callbacks = timing->callbacks, total;
+  size_t nparsed;
+
+#define TIMED(FOR) timed.on_##FOR = settings->on_##FOR ? timed_on_##FOR : NULL
+  TIMED(message_begin);
+  TIMED(url);
+  TIMED(status);
+  TIMED(header_field);
+  TIMED(header_value);
+  TIMED(headers_complete);
+  TIMED(body);
+  TIMED(message_complete);
+  TIMED(chunk_header);
+  TIMED(chunk_complete);
+#undef TIMED
+
+  ctx.settings = settings;
+  ctx.timing = timing;
+  ctx.data = parser->data;
+  parser->data = &ctx;
+
+  start = timing->clock();
+  nparsed = http_parser_execute(parser, &timed, data, len);
+  total = timing->clock() - start;
+
+  parser->data = ctx.data;
+
+  timing->total += total;
+  timing->parser += total - (timing->callbacks - callbacks);
+  return nparsed;
+}
 
-      /* read until EOF */
-      case s_body_identity_eof:
-        MARK(body);
-        p = data + len - 1;
 
-        break;
+/* http_parser_execute_headers() puts a headers_context in parser->data for
+ * the duration of the call, the same way. A name or value that comes in one
+ * piece is left where it is; the second piece moves it, and the name before
+ * it, into the arena, so the token that grows is always the last one there.
+ * Whatever is still in `data` at the end of the call is moved there too.
+ */
+struct headers_context {
+  const http_parser_settings *settings;
+  struct http_parser_headers *headers;
+  void *data;
+  int overflow;
+};
 
-      case s_message_done:
-        UPDATE_STATE(NEW_MESSAGE());
-        CALLBACK_NOTIFY(message_complete);
-        if (parser->upgrade) {
-          /* Exit, the rest of the message is in a different protocol. */
-          RETURN((p - data) + 1);
-        }
-        break;
+#define HEADER_NAME  1
+#define HEADER_VALUE 2
 
-      case s_chunk_size_start:
-      {
-        assert(parser->nread == 1);
-        assert(parser->flags & F_CHUNKED);
+/* Moves `which` into the arena unless it's there already */
+static int
+headers_keep (struct http_parser_headers *h, unsigned which)
+{
+  const char **at = which == HEADER_NAME ? &h->name : &h->value;
+  size_t len = which == HEADER_NAME ? h->name_len : h->value_len;
 
-        unhex_val = unhex[(unsigned char)ch];
-        if (UNLIKELY(unhex_val == -1)) {
-          SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
-          goto error;
-        }
+  if (h->in_arena & which) {
+    return 0;
+  }
 
-        parser->content_length = unhex_val;
-        UPDATE_STATE(s_chunk_size);
-        break;
-      }
+  if (len > h->arena_size - h->arena_used) {
+    return -1;
+  }
 
-      case s_chunk_size:
-      {
-        uint64_t t;
+  if (len > 0) {
+    memcpy(h->arena + h->arena_used, *at, len);
+  }
+  *at = h->arena + h->arena_used;
+  h->arena_used += len;
+  h->in_arena |= which;
+  return 0;
+}
 
-        assert(parser->flags & F_CHUNKED);
+/* Adds a piece to the token that's being parsed */
+static int
+headers_append (struct http_parser_headers *h, unsigned which,
+                const char *at, size_t length)
+{
+  const char **token = which == HEADER_NAME ? &h->name : &h->value;
+  size_t *len = which == HEADER_NAME ? &h->name_len : &h->value_len;
 
-        if (ch == CR) {
-          UPDATE_STATE(s_chunk_size_almost_done);
-          break;
-        }
+  if (*len == 0 && !(h->in_arena & which)) {
+    *token = at;
+    *len = length;
+    return 0;
+  }
 
-        unhex_val = unhex[(unsigned char)ch];
+  if (headers_keep(h, HEADER_NAME) != 0 ||
+      (which == HEADER_VALUE && headers_keep(h, HEADER_VALUE) != 0) ||
+      length > h->arena_size - h->arena_used) {
+    return -1;
+  }
 
-        if (unhex_val == -1) {
-          if (ch == ';' || ch == ' ') {
-            UPDATE_STATE(s_chunk_parameters);
-            break;
-          }
+  memcpy(h->arena + h->arena_used, at, length);
+  h->arena_used += length;
+  *len += length;
+  return 0;
+}
 
-          SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
-          goto error;
-        }
+/* Runs on_header for the header that's complete, if there is one */
+static int
+headers_flush (http_parser *parser, struct headers_context *ctx)
+{
+  struct http_parser_headers *h = ctx->headers;
+  unsigned char header_id = parser->header_id;
+  int rv;
 
-        t = parser->content_length;
-        t *= 16;
-        t += unhex_val;
+  if (h->last == 0) {
+    return 0;
+  }
 
-        /* Overflow? Test against a conservative limit for simplicity. */
-        if (UNLIKELY((ULLONG_MAX - 16) / 16 < parser->content_length)) {
-          SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
-          goto error;
-        }
+  parser->data = ctx->data;
+  parser->header_id = h->header_id;
+  rv = h->on_header(parser, h->name, h->name_len, h->value, h->value_len);
+  parser->header_id = header_id;
+  ctx->data = parser->data;
+  parser->data = ctx;
+
+  h->name_len = h->value_len = 0;
+  h->arena_used = 0;
+  h->in_arena = 0;
+  h->last = 0;
+  return rv == 0 ? 0 : -1;      /* not 1, "no body" to on_headers_complete */
+}
 
-        parser->content_length = t;
-        break;
-      }
+static int
+headers_on_header_field (http_parser *parser, const char *at, size_t length)
+{
+  struct headers_context *ctx = (struct headers_context *) parser->data;
+  struct http_parser_headers *h = ctx->headers;
+  int rv;
 
-      case s_chunk_parameters:
-      {
-        assert(parser->flags & F_CHUNKED);
-        /* just ignore this shit. TODO check for overflow */
-        if (ch == CR) {
-          UPDATE_STATE(s_chunk_size_almost_done);
-          break;
-        }
-        break;
-      }
+  if (h->last == HEADER_VALUE && (rv = headers_flush(parser, ctx)) != 0) {
+    return rv;
+  }
 
-      case s_chunk_size_almost_done:
-      {
-        assert(parser->flags & F_CHUNKED);
-        STRICT_CHECK(ch != LF);
+  h->last = HEADER_NAME;
+  if (headers_append(h, HEADER_NAME, at, length) != 0) {
+    ctx->overflow = 1;
+    return -1;
+  }
+  return 0;
+}
 
-        parser->nread = 0;
+static int
+headers_on_header_value (http_parser *parser, const char *at, size_t length)
+{
+  struct headers_context *ctx = (struct headers_context *) parser->data;
+  struct http_parser_headers *h = ctx->headers;
+
+  h->last = HEADER_VALUE;
+  h->header_id = parser->header_id;
+  if (headers_append(h, HEADER_VALUE, at, length) != 0) {
+    ctx->overflow = 1;
+    return -1;
+  }
+  return 0;
+}
 
-        if (parser->content_length == 0) {
-          parser->flags |= F_TRAILING;
-          UPDATE_STATE(s_header_field_start);
-        } else {
-          UPDATE_STATE(s_chunk_data);
-        }
-        CALLBACK_NOTIFY(chunk_header);
-        break;
-      }
+/* Runs the user's callback with the user's data in parser->data, after
+ * on_header for the last header if FLUSH.
+ */
+#define HEADERS_CALLBACK(FOR, FLUSH, PARAMS, ARGS)                   \
+static int                                                           \
+headers_on_##FOR PARAMS                                              \
+{                                                                    \
+  struct headers_context *ctx;                                      \
+  int rv;                                                            \
+                                                                     \
+  ctx = (struct headers_context *) parser->data;                     \
+                                                                     \
+  if (FLUSH && (rv = headers_flush(parser, ctx)) != 0) {             \
+    return rv;                                                       \
+  }                                                                  \
+  if (ctx->settings->on_##FOR == NULL) {                             \
+    return 0;                                                        \
+  }                                                                  \
+                                                                     \
+  parser->data = ctx->data;                                          \
+  rv = ctx->settings->on_##FOR ARGS;                                 \
+  ctx->data = parser->data;                                          \
+  parser->data = ctx;                                                \
+  return rv;                                                         \
+}
 
-      case s_chunk_data:
-      {
-        uint64_t to_read = MIN(parser->content_length,
-                               (uint64_t) ((data + len) - p));
+#define HEADERS_NOTIFY(FOR, FLUSH)                                   \
+  HEADERS_CALLBACK(FOR, FLUSH, (http_parser *parser), (parser))
+#define HEADERS_DATA(FOR)                                            \
+  HEADERS_CALLBACK(FOR, 0,                                           \
+                   (http_parser *parser, const char *at, size_t length), \
+                   (parser, at, length))
+
+HEADERS_NOTIFY(message_begin, 0)
+HEADERS_DATA(url)
+HEADERS_DATA(status)
+HEADERS_NOTIFY(headers_complete, 1)
+HEADERS_DATA(body)
+HEADERS_NOTIFY(message_complete, 1)
+HEADERS_NOTIFY(chunk_header, 0)
+HEADERS_NOTIFY(chunk_complete, 1)     /* after the trailers */
+
+#undef HEADERS_DATA
+#undef HEADERS_NOTIFY
+#undef HEADERS_CALLBACK
+
+size_t
+http_parser_execute_headers (http_parser *parser,
+                             const http_parser_settings *settings,
+                             const char *data,
+                             size_t len,
+                             struct http_parser_headers *headers)
+{
+  http_parser_settings wrapped;
+  struct headers_context ctx;
+  size_t nparsed;
+
+#define WRAP(FOR) wrapped.on_##FOR = settings->on_##FOR ? headers_on_##FOR : NULL
+  WRAP(message_begin);
+  WRAP(url);
+  WRAP(status);
+  WRAP(body);
+  WRAP(chunk_header);
+#undef WRAP
+  wrapped.on_header_field = headers_on_header_field;
+  wrapped.on_header_value = headers_on_header_value;
+  wrapped.on_headers_complete = headers_on_headers_complete;
+  wrapped.on_message_complete = headers_on_message_complete;
+  wrapped.on_chunk_complete = headers_on_chunk_complete;
+
+  ctx.settings = settings;
+  ctx.headers = headers;
+  ctx.data = parser->data;
+  ctx.overflow = 0;
+  parser->data = &ctx;
+
+  nparsed = http_parser_execute(parser, &wrapped, data, len);
+
+  parser->data = ctx.data;
+
+  /* The callbacks stopped the parser with HPE_CB_*, or `data` goes away
+   * in the middle of a header, which is fine if it's paused.
+   */
+  if (ctx.overflow) {
+    SET_ERRNO(HPE_HEADER_OVERFLOW);
+  } else if (headers->last != 0 &&
+             (headers_keep(headers, HEADER_NAME) != 0 ||
+              (headers->last == HEADER_VALUE &&
+               headers_keep(headers, HEADER_VALUE) != 0)) &&
+             (HTTP_PARSER_ERRNO(parser) == HPE_OK ||
+              HTTP_PARSER_ERRNO(parser) == HPE_PAUSED)) {
+    SET_ERRNO(HPE_HEADER_OVERFLOW);
+  }
 
-        assert(parser->flags & F_CHUNKED);
-        assert(parser->content_length != 0
-            && parser->content_length != ULLONG_MAX);
+  return nparsed;
+}
 
-        /* See the explanation in s_body_identity for why the content
-         * length and data pointers are managed this way.
-         */
-        MARK(body);
-        parser->content_length -= to_read;
-        p += to_read - 1;
+void
+http_parser_headers_init (struct http_parser_headers *headers,
+                          http_header_cb on_header,
+                          char *arena,
+                          size_t arena_size)
+{
+  memset(headers, 0, sizeof(*headers));
+  headers->on_header = on_header;
+  headers->arena = arena;
+  headers->arena_size = arena_size;
+}
 
-        if (parser->content_length == 0) {
-          UPDATE_STATE(s_chunk_data_almost_done);
-        }
+#undef HEADER_NAME
+#undef HEADER_VALUE
 
-        break;
-      }
 
-      case s_chunk_data_almost_done:
-        assert(parser->flags & F_CHUNKED);
-        assert(parser->content_length == 0);
-        STRICT_CHECK(ch != CR);
-        UPDATE_STATE(s_chunk_data_done);
-        CALLBACK_DATA(body);
-        break;
+int
+http_parser_parse_request_headers (http_parser *parser,
+                                   const char *data,
+                                   size_t len,
+                                   const char **url,
+                                   size_t *url_len,
+                                   struct http_parser_header *headers,
+                                   size_t *num_headers)
+{
+  http_parser saved = *parser;
+  struct header_array array;
+  size_t limit = MIN(len, header_room(parser));
+  size_t nparsed;
 
-      case s_chunk_data_done:
-        assert(parser->flags & F_CHUNKED);
-        STRICT_CHECK(ch != LF);
-        parser->nread = 0;
-        UPDATE_STATE(s_chunk_size_start);
-        CALLBACK_NOTIFY(chunk_complete);
-        break;
+  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+    return -1;
+  }
 
-      default:
-        assert(0 && "unhandled state");
-        SET_ERRNO(HPE_INVALID_INTERNAL_STATE);
-        goto error;
-    }
+  if (parser->state != s_start_req) {
+    SET_ERRNO(HPE_INVALID_INTERNAL_STATE);
+    return -1;
   }
 
-  /* Run callbacks for any marks that we have leftover after we ran our of
-   * bytes. There should be at most one of these set, so it's OK to invoke
-   * them in series (unset marks will not result in callbacks).
-   *
-   * We use the NOADVANCE() variety of callbacks here because 'p' has already
-   * overflowed 'data' and this allows us to correct for the off-by-one that
-   * we'd otherwise have (since CALLBACK_DATA() is meant to be run with a 'p'
-   * value that's in-bounds).
-   */
+  array.url = NULL;
+  array.url_len = 0;
+  array.headers = headers;
+  array.num_headers = 0;
+  array.max_headers = *num_headers;
+  array.value_pending = 0;
+  array.done = 0;
 
-  assert(((header_field_mark ? 1 : 0) +
-          (header_value_mark ? 1 : 0) +
-          (url_mark ? 1 : 0)  +
-          (body_mark ? 1 : 0) +
-          (status_mark ? 1 : 0)) <= 1);
+  /* There's no header size accounting; stopping at the limit does it */
+  nparsed = execute_header_array(parser, &array, data, limit);
 
-  CALLBACK_DATA_NOADVANCE(header_field);
-  CALLBACK_DATA_NOADVANCE(header_value);
-  CALLBACK_DATA_NOADVANCE(url);
-  CALLBACK_DATA_NOADVANCE(body);
-  CALLBACK_DATA_NOADVANCE(status);
+  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+    return -1;
+  }
 
-  RETURN(len);
+  if (!array.done) {
+    if (limit < len) {
+      SET_ERRNO(HPE_HEADER_OVERFLOW);
+      return -1;
+    }
 
-error:
-  if (HTTP_PARSER_ERRNO(parser) == HPE_OK) {
-    SET_ERRNO(HPE_UNKNOWN);
+    *parser = saved;
+    return -2;
   }
 
-  RETURN(p - data);
+  *url = array.url;
+  *url_len = array.url_len;
+  *num_headers = array.num_headers;
+
+  return (int) nparsed;
 }
 
 
@@ -1878,6 +755,13 @@ http_method_str (enum http_method m)
 }
 
 
+const char *
+http_header_str (enum http_header_id h)
+{
+  return ELEM_AT(header_strings, h, "<unknown>");
+}
+
+
 void
 http_parser_init (http_parser *parser, enum http_parser_type t)
 {
@@ -1885,10 +769,135 @@ http_parser_init (http_parser *parser, enum http_parser_type t)
   memset(parser, 0, sizeof(*parser));
   parser->data = data;
   parser->type = t;
-  parser->state = s_start_req;
+  parser->state = (t == HTTP_REQUEST ? s_start_req :
+                   (t == HTTP_RESPONSE ? s_start_res : s_start_req_or_res));
   parser->http_errno = HPE_OK;
 }
 
+void
+http_parser_reset (http_parser *parser, enum http_parser_type t)
+{
+  /* Every bit-field of the first word is written, so the compiler can
+   * merge them into one store
+   */
+  parser->type = t;
+  parser->flags = 0;
+  parser->state = (t == HTTP_REQUEST ? s_start_req :
+                   (t == HTTP_RESPONSE ? s_start_res : s_start_req_or_res));
+  parser->header_state = 0;
+  parser->index = 0;
+  parser->nread = 0;
+  /* Responses look at the method, for CONNECT */
+  parser->status_code = 0;
+  parser->method = 0;
+  parser->http_errno = HPE_OK;
+  parser->upgrade = 0;
+  parser->header_id = 0;
+  parser->header_id_index = 0;
+}
+
+void
+http_parser_pool_init (struct http_parser_pool *pool,
+                       enum http_parser_type type)
+{
+  pool->free = NULL;
+  pool->type = type;
+  pool->available = 0;
+}
+
+void
+http_parser_pool_add (struct http_parser_pool *pool,
+                      http_parser *parsers,
+                      size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    parsers[i].data = NULL;
+    http_parser_init(&parsers[i], pool->type);
+    parsers[i].data = pool->free;
+    pool->free = &parsers[i];
+  }
+  pool->available += n;
+}
+
+http_parser *
+http_parser_pool_acquire (struct http_parser_pool *pool, void *data)
+{
+  http_parser *parser = pool->free;
+
+  if (parser == NULL) {
+    return NULL;
+  }
+
+  pool->free = (http_parser *) parser->data;
+  pool->available--;
+  parser->data = data;
+  return parser;
+}
+
+void
+http_parser_pool_release (struct http_parser_pool *pool, http_parser *parser)
+{
+  http_parser_reset(parser, pool->type);
+  parser->data = pool->free;
+  pool->free = parser;
+  pool->available++;
+}
+
+/* Fails to compile if struct http_parser_compact grows past 24 bytes */
+enum { compact_fits = 1 / (sizeof(struct http_parser_compact) <= 24) };
+
+void
+http_parser_save (const http_parser *parser,
+                  struct http_parser_compact_state *state,
+                  struct http_parser_compact_message *message)
+{
+  assert(parser->status_code < 1024 &&
+         parser->http_major < 1024 &&
+         parser->http_minor < 1024);
+
+  state->type = parser->type;
+  state->flags = parser->flags;
+  state->state = parser->state;
+  state->header_state = parser->header_state;
+  state->index = parser->index;
+  state->http_errno = parser->http_errno;
+  state->upgrade = parser->upgrade;
+  state->header_id = parser->header_id;
+  state->header_id_index = parser->header_id_index;
+  state->method = parser->method;
+
+  message->nread = parser->nread;
+  message->status_code = parser->status_code;
+  message->http_major = parser->http_major;
+  message->http_minor = parser->http_minor;
+  message->content_length = parser->content_length;
+}
+
+void
+http_parser_load (http_parser *parser,
+                  const struct http_parser_compact_state *state,
+                  const struct http_parser_compact_message *message)
+{
+  parser->type = state->type;
+  parser->flags = state->flags;
+  parser->state = state->state;
+  parser->header_state = state->header_state;
+  parser->index = state->index;
+  parser->http_errno = state->http_errno;
+  parser->upgrade = state->upgrade;
+  parser->header_id = state->header_id;
+  parser->header_id_index = state->header_id_index;
+  parser->method = state->method;
+
+  parser->nread = message->nread;
+  parser->status_code = message->status_code;
+  parser->http_major = message->http_major;
+  parser->http_minor = message->http_minor;
+  parser->content_length = message->content_length;
+}
+
 void
 http_parser_settings_init(http_parser_settings *settings)
 {
@@ -2084,7 +1093,7 @@ http_parser_parse_url(const char *buf, size_t buflen, int is_connect,
       case s_req_server_with_at:
         found_at = 1;
 
-      /* FALLTROUGH */
+      /* FALLTHROUGH */
       case s_req_server:
         uf = UF_HOST;
         break;
@@ -2160,6 +1169,7 @@ http_parser_pause(http_parser *parser, int paused) {
    */
   if (HTTP_PARSER_ERRNO(parser) == HPE_OK ||
       HTTP_PARSER_ERRNO(parser) == HPE_PAUSED) {
+    PROBE2(pause, parser, paused);
     SET_ERRNO((paused) ? HPE_PAUSED : HPE_OK);
   } else {
     assert(0 && "Attempting to pause parser in error state");
@@ -2177,3 +1187,128 @@ http_parser_version(void) {
          HTTP_PARSER_VERSION_MINOR * 0x00100 |
          HTTP_PARSER_VERSION_PATCH * 0x00001;
 }
+
+#if HTTP_PARSER_STATS
+struct http_parser_stats http_parser_stats_counters;
+
+#define STATE_NAME(S) [S] = #S
+static const char *const state_names[] =
+  { STATE_NAME(s_dead)
+  , STATE_NAME(s_start_req_or_res)
+  , STATE_NAME(s_res_or_resp_H)
+  , STATE_NAME(s_start_res)
+  , STATE_NAME(s_res_H)
+  , STATE_NAME(s_res_HT)
+  , STATE_NAME(s_res_HTT)
+  , STATE_NAME(s_res_HTTP)
+  , STATE_NAME(s_res_first_http_major)
+  , STATE_NAME(s_res_http_major)
+  , STATE_NAME(s_res_first_http_minor)
+  , STATE_NAME(s_res_http_minor)
+  , STATE_NAME(s_res_first_status_code)
+  , STATE_NAME(s_res_status_code)
+  , STATE_NAME(s_res_status_start)
+  , STATE_NAME(s_res_status)
+  , STATE_NAME(s_res_line_almost_done)
+  , STATE_NAME(s_start_req)
+  , STATE_NAME(s_req_method)
+  , STATE_NAME(s_req_spaces_before_url)
+  , STATE_NAME(s_req_schema)
+  , STATE_NAME(s_req_schema_slash)
+  , STATE_NAME(s_req_schema_slash_slash)
+  , STATE_NAME(s_req_server_start)
+  , STATE_NAME(s_req_server)
+  , STATE_NAME(s_req_server_with_at)
+  , STATE_NAME(s_req_path)
+  , STATE_NAME(s_req_query_string_start)
+  , STATE_NAME(s_req_query_string)
+  , STATE_NAME(s_req_fragment_start)
+  , STATE_NAME(s_req_fragment)
+  , STATE_NAME(s_req_http_start)
+  , STATE_NAME(s_req_http_H)
+  , STATE_NAME(s_req_http_HT)
+  , STATE_NAME(s_req_http_HTT)
+  , STATE_NAME(s_req_http_HTTP)
+  , STATE_NAME(s_req_first_http_major)
+  , STATE_NAME(s_req_http_major)
+  , STATE_NAME(s_req_first_http_minor)
+  , STATE_NAME(s_req_http_minor)
+  , STATE_NAME(s_req_line_almost_done)
+  , STATE_NAME(s_header_field_start)
+  , STATE_NAME(s_header_field)
+  , STATE_NAME(s_header_value_discard_ws)
+  , STATE_NAME(s_header_value_discard_ws_almost_done)
+  , STATE_NAME(s_header_value_discard_lws)
+  , STATE_NAME(s_header_value_start)
+  , STATE_NAME(s_header_value)
+  , STATE_NAME(s_header_value_lws)
+  , STATE_NAME(s_header_almost_done)
+  , STATE_NAME(s_chunk_size_start)
+  , STATE_NAME(s_chunk_size)
+  , STATE_NAME(s_chunk_parameters)
+  , STATE_NAME(s_chunk_size_almost_done)
+  , STATE_NAME(s_headers_almost_done)
+  , STATE_NAME(s_headers_done)
+  , STATE_NAME(s_chunk_data)
+  , STATE_NAME(s_chunk_data_almost_done)
+  , STATE_NAME(s_chunk_data_done)
+  , STATE_NAME(s_body_identity)
+  , STATE_NAME(s_body_identity_eof)
+  , STATE_NAME(s_message_done)
+  };
+#undef STATE_NAME
+
+void
+http_parser_stats_reset(void)
+{
+  memset(&http_parser_stats_counters, 0, sizeof(http_parser_stats_counters));
+}
+
+const char *
+http_parser_state_name(unsigned int state)
+{
+  const char *name = ELEM_AT(state_names, state, NULL);
+  return name ? name : "<unknown>";
+}
+
+void
+http_parser_stats_dump(FILE *out)
+{
+  const struct http_parser_stats *stats = &http_parser_stats_counters;
+  unsigned int i, j;
+
+  fprintf(out, "%-40s %14s %14s\n", "state", "bytes", "bulk bytes");
+  for (i = 0; i < HTTP_PARSER_STATS_STATES; i++) {
+    if (stats->bytes[i] || stats->bulk_bytes[i]) {
+      fprintf(out, "%-40s %14llu %14llu\n", http_parser_state_name(i),
+              (unsigned long long) stats->bytes[i],
+              (unsigned long long) stats->bulk_bytes[i]);
+    }
+  }
+
+  fprintf(out, "\n%-80s %14s\n", "transition", "count");
+  for (i = 0; i < HTTP_PARSER_STATS_STATES; i++) {
+    for (j = 0; j < HTTP_PARSER_STATS_STATES; j++) {
+      if (stats->transitions[i][j]) {
+        fprintf(out, "%-38s -> %-38s %14llu\n",
+                http_parser_state_name(i), http_parser_state_name(j),
+                (unsigned long long) stats->transitions[i][j]);
+      }
+    }
+  }
+
+  fprintf(out, "\n%-40s %14s\n", "callback", "count");
+  for (i = 0; i < HTTP_PARSER_CALLBACKS; i++) {
+    if (stats->callbacks[i]) {
+      /* "HPE_CB_url" -> "on_url" */
+      const char *name =
+        http_errno_name((enum http_errno) (HPE_CB_message_begin + i));
+      fprintf(out, "on_%-37s %14llu\n", name + sizeof("HPE_CB_") - 1,
+              (unsigned long long) stats->callbacks[i]);
+    }
+  }
+
+  fprintf(out, "\n%-40s %14llu\n", "reexecutes",
+          (unsigned long long) stats->reexecutes);
+}
+#endif
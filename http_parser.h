@@ -25,8 +25,8 @@ extern "C" {
 #endif
 
 /* Also update SONAME in the Makefile whenever you change these. */
-#define HTTP_PARSER_VERSION_MAJOR 2
-#define HTTP_PARSER_VERSION_MINOR 5
+#define HTTP_PARSER_VERSION_MAJOR 3
+#define HTTP_PARSER_VERSION_MINOR 0
 #define HTTP_PARSER_VERSION_PATCH 0
 
 #include <sys/types.h>
@@ -52,6 +52,57 @@ typedef unsigned __int64 uint64_t;
 # define HTTP_PARSER_STRICT 1
 #endif
 
+/* Compile with -DHTTP_PARSER_HEADER_BLOCK=1 to start each request with a
+ * second copy of the state machine that skips the header size accounting
+ * while the buffer is too short to overflow it. Not measurably faster yet.
+ */
+#ifndef HTTP_PARSER_HEADER_BLOCK
+# define HTTP_PARSER_HEADER_BLOCK 0
+#endif
+
+/* Compile with -DHTTP_PARSER_THREADED=1 to jump from state to state through
+ * a table of label addresses instead of a switch. Needs GCC or Clang.
+ */
+#ifndef HTTP_PARSER_THREADED
+# define HTTP_PARSER_THREADED 0
+#endif
+
+/* Compile with -DHTTP_PARSER_STATS=1 to count the bytes, state transitions
+ * and callbacks of every parser in http_parser_stats_counters. Off, the
+ * counting compiles to nothing.
+ */
+#ifndef HTTP_PARSER_STATS
+# define HTTP_PARSER_STATS 0
+#endif
+
+/* Compile with -DHTTP_PARSER_USDT=1 to add SystemTap/USDT probes, provider
+ * http_parser, for bpftrace and friends. Needs <sys/sdt.h> (systemtap-sdt-dev
+ * or similar); a probe is a nop until something attaches to it.
+ *
+ *   message_begin, headers_complete, message_complete, chunk_header,
+ *   chunk_complete (parser, offset, content_length)
+ *     where the callback of the same name runs, whether it is set or not.
+ *     offset is that of the current byte in the buffer being parsed and
+ *     content_length is parser->content_length, e.g. the chunk size for
+ *     chunk_header.
+ *   error (parser, http_errno)
+ *     when the parser fails, callback errors included
+ *   pause (parser, paused)
+ *     from http_parser_pause()
+ *
+ * For example, the time from message_begin to headers_complete per parser
+ * is how long the head took to arrive and parse:
+ *
+ *   bpftrace -e 'usdt:./libhttp_parser.so:http_parser:message_begin
+ *                  { @start[arg0] = nsecs; }
+ *                usdt:./libhttp_parser.so:http_parser:headers_complete
+ *                  /@start[arg0]/ { @head_ns = hist(nsecs - @start[arg0]);
+ *                                   delete(@start[arg0]); }'
+ */
+#ifndef HTTP_PARSER_USDT
+# define HTTP_PARSER_USDT 0
+#endif
+
 /* Maximium header size allowed. If the macro is not defined
  * before including this header then the default is used. To
  * change the maximum header size, define the macro in the build
@@ -128,6 +179,91 @@ enum http_method
   };
 
 
+/* Well-known header names, recognised case-insensitively while parsing.
+ * Keep this list sorted by name: the parser relies on the order when a
+ * header name arrives in several pieces. Regenerate the hash tables in
+ * http_parser.c with contrib/header_hash.c after changing it.
+ */
+#define HTTP_HEADER_MAP(XX)                                                 \
+  XX(1,   ACCEPT,                          accept)                          \
+  XX(2,   ACCEPT_CHARSET,                  accept-charset)                  \
+  XX(3,   ACCEPT_ENCODING,                 accept-encoding)                 \
+  XX(4,   ACCEPT_LANGUAGE,                 accept-language)                 \
+  XX(5,   ACCEPT_RANGES,                   accept-ranges)                   \
+  XX(6,   ACCESS_CONTROL_ALLOW_ORIGIN,     access-control-allow-origin)     \
+  XX(7,   ACCESS_CONTROL_REQUEST_HEADERS,  access-control-request-headers)  \
+  XX(8,   ACCESS_CONTROL_REQUEST_METHOD,   access-control-request-method)   \
+  XX(9,   AGE,                             age)                             \
+  XX(10,  ALLOW,                           allow)                           \
+  XX(11,  AUTHORIZATION,                   authorization)                   \
+  XX(12,  CACHE_CONTROL,                   cache-control)                   \
+  XX(13,  CONNECTION,                      connection)                      \
+  XX(14,  CONTENT_DISPOSITION,             content-disposition)             \
+  XX(15,  CONTENT_ENCODING,                content-encoding)                \
+  XX(16,  CONTENT_LANGUAGE,                content-language)                \
+  XX(17,  CONTENT_LENGTH,                  content-length)                  \
+  XX(18,  CONTENT_LOCATION,                content-location)                \
+  XX(19,  CONTENT_MD5,                     content-md5)                     \
+  XX(20,  CONTENT_RANGE,                   content-range)                   \
+  XX(21,  CONTENT_TYPE,                    content-type)                    \
+  XX(22,  COOKIE,                          cookie)                          \
+  XX(23,  DATE,                            date)                            \
+  XX(24,  DNT,                             dnt)                             \
+  XX(25,  ETAG,                            etag)                            \
+  XX(26,  EXPECT,                          expect)                          \
+  XX(27,  EXPIRES,                         expires)                         \
+  XX(28,  FORWARDED,                       forwarded)                       \
+  XX(29,  FROM,                            from)                            \
+  XX(30,  HOST,                            host)                            \
+  XX(31,  IF_MATCH,                        if-match)                        \
+  XX(32,  IF_MODIFIED_SINCE,               if-modified-since)               \
+  XX(33,  IF_NONE_MATCH,                   if-none-match)                   \
+  XX(34,  IF_RANGE,                        if-range)                        \
+  XX(35,  IF_UNMODIFIED_SINCE,             if-unmodified-since)             \
+  XX(36,  KEEP_ALIVE,                      keep-alive)                      \
+  XX(37,  LAST_MODIFIED,                   last-modified)                   \
+  XX(38,  LINK,                            link)                            \
+  XX(39,  LOCATION,                        location)                        \
+  XX(40,  MAX_FORWARDS,                    max-forwards)                    \
+  XX(41,  ORIGIN,                          origin)                          \
+  XX(42,  PRAGMA,                          pragma)                          \
+  XX(43,  PROXY_AUTHORIZATION,             proxy-authorization)             \
+  XX(44,  PROXY_CONNECTION,                proxy-connection)                \
+  XX(45,  RANGE,                           range)                           \
+  XX(46,  REFERER,                         referer)                         \
+  XX(47,  RETRY_AFTER,                     retry-after)                     \
+  XX(48,  SEC_WEBSOCKET_EXTENSIONS,        sec-websocket-extensions)        \
+  XX(49,  SEC_WEBSOCKET_KEY,               sec-websocket-key)               \
+  XX(50,  SEC_WEBSOCKET_PROTOCOL,          sec-websocket-protocol)          \
+  XX(51,  SEC_WEBSOCKET_VERSION,           sec-websocket-version)           \
+  XX(52,  SERVER,                          server)                          \
+  XX(53,  SET_COOKIE,                      set-cookie)                      \
+  XX(54,  TE,                              te)                              \
+  XX(55,  TRAILER,                         trailer)                         \
+  XX(56,  TRANSFER_ENCODING,               transfer-encoding)               \
+  XX(57,  UPGRADE,                         upgrade)                         \
+  XX(58,  UPGRADE_INSECURE_REQUESTS,       upgrade-insecure-requests)       \
+  XX(59,  USER_AGENT,                      user-agent)                      \
+  XX(60,  VARY,                            vary)                            \
+  XX(61,  VIA,                             via)                             \
+  XX(62,  WARNING,                         warning)                         \
+  XX(63,  WWW_AUTHENTICATE,                www-authenticate)                \
+  XX(64,  X_CSRF_TOKEN,                    x-csrf-token)                    \
+  XX(65,  X_FORWARDED_FOR,                 x-forwarded-for)                 \
+  XX(66,  X_FORWARDED_HOST,                x-forwarded-host)                \
+  XX(67,  X_FORWARDED_PROTO,               x-forwarded-proto)               \
+  XX(68,  X_REAL_IP,                       x-real-ip)                       \
+  XX(69,  X_REQUEST_ID,                    x-request-id)                    \
+  XX(70,  X_REQUESTED_WITH,                x-requested-with)                \
+
+enum http_header_id
+  {
+  HTTP_HEADER_OTHER = 0,
+#define XX(num, name, string) HTTP_HEADER_##name = num,
+  HTTP_HEADER_MAP(XX)
+#undef XX
+  };
+
 enum http_parser_type { HTTP_REQUEST, HTTP_RESPONSE, HTTP_BOTH };
 
 
@@ -228,6 +364,15 @@ struct http_parser {
    */
   unsigned int upgrade : 1;
 
+  /* enum http_header_id of the current header name. Valid once the name is
+   * complete, i.e. in the last on_header_field callback for the name and in
+   * the on_header_value callbacks that follow it.
+   */
+  unsigned int header_id : 8;
+
+  /** PRIVATE **/
+  unsigned int header_id_index : 8; /* bytes of a split name matched so far */
+
   /** PUBLIC **/
   void *data; /* A pointer to get hook to the "connection" or "socket" object */
 };
@@ -249,6 +394,11 @@ struct http_parser_settings {
   http_cb      on_chunk_complete;
 };
 
+/* The number of callbacks in http_parser_settings. Counters per callback
+ * are indexed by HPE_CB_<name> - HPE_CB_message_begin.
+ */
+#define HTTP_PARSER_CALLBACKS 10
+
 
 enum http_parser_url_fields
   { UF_SCHEMA           = 0
@@ -280,6 +430,56 @@ struct http_parser_url {
 };
 
 
+/* A header line of a request head; see http_parser_parse_request_headers().
+ * `name` and `value` point into the parsed buffer.
+ */
+struct http_parser_header {
+  const char *name;             /* NULL for a folded continuation line */
+  size_t name_len;
+  const char *value;
+  size_t value_len;
+};
+
+
+/* An http_parser packed into 24 bytes, for servers that keep one per
+ * mostly idle connection and load it into a full http_parser only to run
+ * it; see http_parser_save(). `data` isn't kept, as the connection that
+ * holds the compact parser knows where it is. The version numbers and the
+ * status code take 10 bits, which is enough for anything the parser
+ * accepts.
+ *
+ * The two halves also work apart, e.g. as arrays of states and of
+ * messages for a pool of parsers, where a scan for the connections that
+ * are in the middle of a message reads only the states.
+ */
+struct http_parser_compact_state {
+  unsigned int type : 2;
+  unsigned int flags : 7;
+  unsigned int state : 7;
+  unsigned int header_state : 8;
+  unsigned int index : 8;
+
+  unsigned int http_errno : 7;
+  unsigned int upgrade : 1;
+  unsigned int header_id : 8;
+  unsigned int header_id_index : 8;
+  unsigned int method : 8;
+};
+
+struct http_parser_compact_message {
+  uint32_t nread;
+  unsigned int status_code : 10;
+  unsigned int http_major : 10;
+  unsigned int http_minor : 10;
+  uint64_t content_length;
+};
+
+struct http_parser_compact {
+  struct http_parser_compact_state state;
+  struct http_parser_compact_message message;
+};
+
+
 /* Returns the library version. Bits 16-23 contain the major version number,
  * bits 8-15 the minor version number and bits 0-7 the patch level.
  * Usage example:
@@ -294,6 +494,57 @@ unsigned long http_parser_version(void);
 
 void http_parser_init(http_parser *parser, enum http_parser_type type);
 
+/* Makes a parser that has been used before ready for a new stream, like
+ * http_parser_init(), but only writes the fields that the first message
+ * doesn't set itself before it gets to them. The version and the content
+ * length keep their old values until then, and `data` is left alone.
+ */
+void http_parser_reset(http_parser *parser, enum http_parser_type type);
+
+
+/* A free list of parsers that are ready to go, for servers that accept
+ * connections at a high rate. The parsers live in memory the caller hands
+ * over with http_parser_pool_add(); a free one keeps the link to the next
+ * in `data`. A pool isn't synchronized: give each thread its own.
+ */
+struct http_parser_pool {
+  http_parser *free;
+  enum http_parser_type type;
+  size_t available;
+};
+
+/* An empty pool of parsers for streams of `type` */
+void http_parser_pool_init(struct http_parser_pool *pool,
+                           enum http_parser_type type);
+
+/* Initializes parsers[0, n) and adds them to the pool */
+void http_parser_pool_add(struct http_parser_pool *pool,
+                          http_parser *parsers,
+                          size_t n);
+
+/* Takes a parser from the pool with `data` set to `data`, or returns NULL
+ * if the pool is empty
+ */
+http_parser *http_parser_pool_acquire(struct http_parser_pool *pool,
+                                      void *data);
+
+/* Resets a parser from http_parser_pool_acquire() and puts it back; it may
+ * stop anywhere in a stream, errors included
+ */
+void http_parser_pool_release(struct http_parser_pool *pool,
+                              http_parser *parser);
+
+
+/* Copy everything but `data` between a parser and its compact form. A
+ * loaded parser continues exactly where the saved one stopped.
+ */
+void http_parser_save(const http_parser *parser,
+                      struct http_parser_compact_state *state,
+                      struct http_parser_compact_message *message);
+void http_parser_load(http_parser *parser,
+                      const struct http_parser_compact_state *state,
+                      const struct http_parser_compact_message *message);
+
 
 /* Initialize http_parser_settings members to 0
  */
@@ -308,6 +559,139 @@ size_t http_parser_execute(http_parser *parser,
                            size_t len);
 
 
+/* Runs http_parser_execute(parsers[i], settings, data[i], lens[i]) for each
+ * i < n and stores what it returns in nparsed[i]. The parsers are
+ * independent, e.g. one per readable connection; while one runs, the next
+ * parser and the start of its data are prefetched, so the caches stay warm
+ * across many connections. Check each parser for errors as after
+ * http_parser_execute().
+ */
+void http_parser_execute_batch(http_parser *const parsers[],
+                               const http_parser_settings *settings,
+                               const char *const data[],
+                               const size_t lens[],
+                               size_t n,
+                               size_t nparsed[]);
+
+
+#if !defined(_WIN32)
+struct iovec;
+
+/* http_parser_execute() over the `iovcnt` segments of a readv(), in order,
+ * in one call; empty segments are skipped, and iovcnt == 0 signals EOF.
+ * Returns the number of bytes parsed and stores where the parser stopped
+ * in *segment and *offset: iov[*segment].iov_base + *offset is what
+ * http_parser_execute() would have returned for that segment, or
+ * *segment == iovcnt and *offset == 0 if it parsed everything. It stops
+ * early on the same things: an error, a pause and an upgrade.
+ */
+size_t http_parser_execute_iov(http_parser *parser,
+                               const http_parser_settings *settings,
+                               const struct iovec *iov,
+                               int iovcnt,
+                               int *segment,
+                               size_t *offset);
+#endif
+
+
+/* Where the time of http_parser_execute_timed() calls goes, in the units
+ * of `clock`, which the caller sets (a clock_gettime() in ns, a cycle
+ * counter, ...). The other fields add up over the calls; zero them to
+ * start over.
+ */
+struct http_parser_timing {
+  uint64_t (*clock)(void);
+  uint64_t total;                 /* in http_parser_execute_timed() */
+  uint64_t parser;                /* total minus the callbacks */
+  uint64_t callbacks;             /* in the callbacks */
+  uint64_t callback_time[HTTP_PARSER_CALLBACKS];
+  uint64_t callback_calls[HTTP_PARSER_CALLBACKS];
+};
+
+/* http_parser_execute(), timing each callback on its own so a slow parse
+ * can be told apart from slow callbacks. The callbacks see parser->data as
+ * usual. Reading the clock twice per callback is counted as parser time,
+ * so use a cheap clock.
+ */
+size_t http_parser_execute_timed(http_parser *parser,
+                                 const http_parser_settings *settings,
+                                 const char *data,
+                                 size_t len,
+                                 struct http_parser_timing *timing);
+
+
+/* A whole header line for http_parser_execute_headers(). parser->header_id
+ * is that of `name`.
+ */
+typedef int (*http_header_cb) (http_parser*,
+                               const char *name, size_t name_len,
+                               const char *value, size_t value_len);
+
+/* Puts the pieces of each header back together for on_header. `arena` is
+ * memory of `arena_size` bytes for the headers that span two or more
+ * calls. Keep one per parser and set it up with http_parser_headers_init().
+ */
+struct http_parser_headers {
+  http_header_cb on_header;
+  char *arena;
+  size_t arena_size;
+
+  /** PRIVATE **/
+  const char *name;
+  size_t name_len;
+  const char *value;
+  size_t value_len;
+  size_t arena_used;
+  unsigned char in_arena;         /* bit 0: name, bit 1: value */
+  unsigned char last;             /* 0, 1: in the name, 2: in the value */
+  unsigned char header_id;
+};
+
+/* http_parser_execute() with on_header called once per header instead of
+ * on_header_field and on_header_value, which `settings` needn't set. name
+ * and value point into `data` when the header is in one piece there, which
+ * is almost always, and into the arena when it came in pieces (a split
+ * buffer, a folded value). A header that doesn't fit into the arena stops
+ * the parser with HPE_HEADER_OVERFLOW, possibly with all of `data` parsed
+ * if it's the last header in the buffer.
+ */
+size_t http_parser_execute_headers(http_parser *parser,
+                                   const http_parser_settings *settings,
+                                   const char *data,
+                                   size_t len,
+                                   struct http_parser_headers *headers);
+
+/* Initializes `headers` for a new stream. Call it again whenever the parser
+ * is, by http_parser_init(), http_parser_reset() or the pool, or a header
+ * cut short by the old stream ends up glued to the first of the next.
+ */
+void http_parser_headers_init(struct http_parser_headers *headers,
+                              http_header_cb on_header,
+                              char *arena,
+                              size_t arena_size);
+
+
+/* Parses the request line and headers at the start of data[0, len) in one
+ * go, without running any callbacks. `parser` must be between messages,
+ * e.g. just initialized for HTTP_REQUEST; the method and version end up
+ * there and the url and headers in `*url` and `headers`. `*num_headers`
+ * is the size of `headers` on input and the number of entries on output.
+ *
+ * Returns the number of bytes in the head, -2 if `data` ends before the
+ * head does (the parser is left as it was; call again with more data) or
+ * -1 on error. More headers than fit in `headers` is HPE_HEADER_OVERFLOW.
+ * On success the parser is ready for http_parser_execute() to parse the
+ * body, if any.
+ */
+int http_parser_parse_request_headers(http_parser *parser,
+                                      const char *data,
+                                      size_t len,
+                                      const char **url,
+                                      size_t *url_len,
+                                      struct http_parser_header *headers,
+                                      size_t *num_headers);
+
+
 /* If http_should_keep_alive() in the on_headers_complete or
  * on_message_complete callback returns 0, then this should be
  * the last message on the connection.
@@ -316,9 +700,17 @@ size_t http_parser_execute(http_parser *parser,
  */
 int http_should_keep_alive(const http_parser *parser);
 
+/* Returns 1 if the body of the current message runs until EOF, that is a
+ * response with neither Content-Length nor chunked encoding.
+ */
+int http_message_needs_eof(const http_parser *parser);
+
 /* Returns a string version of the HTTP method. */
 const char *http_method_str(enum http_method m);
 
+/* Returns the lowercase name of a well-known header. */
+const char *http_header_str(enum http_header_id h);
+
 /* Return a string name of the given error */
 const char *http_errno_name(enum http_errno err);
 
@@ -336,6 +728,43 @@ void http_parser_pause(http_parser *parser, int paused);
 /* Checks if this is the final chunk of the body. */
 int http_body_is_final(const http_parser *parser);
 
+#if HTTP_PARSER_STATS
+#include <stdio.h>
+
+#define HTTP_PARSER_STATS_STATES 64
+
+/* What the parsers did since the last http_parser_stats_reset(). States
+ * are the parser's internal states, see http_parser_state_name().
+ *
+ * The counters are shared by all parsers and not synchronized, so with
+ * parsers on several threads they are approximate.
+ */
+struct http_parser_stats {
+  /* Bytes the main loop stepped through one at a time in each state */
+  uint64_t bytes[HTTP_PARSER_STATS_STATES];
+  /* Bytes a state consumed in one go: scans for the end of a header name,
+   * value or url, body runs and the fast paths for common lines
+   */
+  uint64_t bulk_bytes[HTTP_PARSER_STATS_STATES];
+  /* transitions[from][to] */
+  uint64_t transitions[HTTP_PARSER_STATS_STATES][HTTP_PARSER_STATS_STATES];
+  /* Bytes handed on to another state to look at again */
+  uint64_t reexecutes;
+  uint64_t callbacks[HTTP_PARSER_CALLBACKS];
+};
+
+extern struct http_parser_stats http_parser_stats_counters;
+
+/* Zeroes http_parser_stats_counters */
+void http_parser_stats_reset(void);
+
+/* Prints the non-zero counters to `out`, one per line */
+void http_parser_stats_dump(FILE *out);
+
+/* Returns the name of an internal state, e.g. "s_header_field" */
+const char *http_parser_state_name(unsigned int state);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
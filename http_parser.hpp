@@ -0,0 +1,436 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef http_parser_hpp
+#define http_parser_hpp
+
+/* C++17 front end to the state machine of http_parser.c.
+ *
+ * basic_parser<Handler> compiles the engines of http_parser_engine.h again
+ * with Handler's member functions in place of http_parser_settings, so the
+ * callbacks are bound at compile time: the ones Handler doesn't declare
+ * disappear from the loop and small ones are inlined into it.
+ *
+ *   struct my_parser : http::basic_parser<my_parser> {
+ *     my_parser() : basic_parser(HTTP_REQUEST) {}
+ *
+ *     int on_url(const char *at, size_t length);
+ *     int on_headers_complete();
+ *   };
+ *
+ * Handler derives from basic_parser<Handler> and declares any of the
+ * callbacks of http_parser_settings as public members, without the parser
+ * argument: on_message_begin(), on_url(at, length), ... The return values
+ * mean what they mean in C; a callback may also return void. The parser is
+ * in native() and still needs the C library for http_should_keep_alive(),
+ * http_errno_name() and the rest of the API.
+ */
+
+#include "http_parser.h"
+
+#include <assert.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if HTTP_PARSER_USDT
+# include <sys/sdt.h>
+#endif
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#include <type_traits>
+#include <utility>
+
+/* The state machine's macros have generic names (MIN, CR, TOKEN, ...).
+ * Save any the includer defined and put them back at the end.
+ */
+#pragma push_macro("ARRAY_SIZE")
+#undef ARRAY_SIZE
+#pragma push_macro("BIT_AT")
+#undef BIT_AT
+#pragma push_macro("CALLBACK_DATA")
+#undef CALLBACK_DATA
+#pragma push_macro("CALLBACK_DATA_")
+#undef CALLBACK_DATA_
+#pragma push_macro("CALLBACK_DATA_NOADVANCE")
+#undef CALLBACK_DATA_NOADVANCE
+#pragma push_macro("CALLBACK_NOTIFY")
+#undef CALLBACK_NOTIFY
+#pragma push_macro("CALLBACK_NOTIFY_")
+#undef CALLBACK_NOTIFY_
+#pragma push_macro("CALLBACK_NOTIFY_NOADVANCE")
+#undef CALLBACK_NOTIFY_NOADVANCE
+#pragma push_macro("CHUNKED")
+#undef CHUNKED
+#pragma push_macro("CLOSE")
+#undef CLOSE
+#pragma push_macro("CONNECTION")
+#undef CONNECTION
+#pragma push_macro("CONTENT_LENGTH")
+#undef CONTENT_LENGTH
+#pragma push_macro("CR")
+#undef CR
+#pragma push_macro("CURRENT_STATE")
+#undef CURRENT_STATE
+#pragma push_macro("ELEM_AT")
+#undef ELEM_AT
+#pragma push_macro("FALLTHROUGH")
+#undef FALLTHROUGH
+#pragma push_macro("HEADER_RUN_CHARGE")
+#undef HEADER_RUN_CHARGE
+#pragma push_macro("HEADER_RUN_START")
+#undef HEADER_RUN_START
+#pragma push_macro("IS_ALPHA")
+#undef IS_ALPHA
+#pragma push_macro("IS_ALPHANUM")
+#undef IS_ALPHANUM
+#pragma push_macro("IS_HEX")
+#undef IS_HEX
+#pragma push_macro("IS_HOST_CHAR")
+#undef IS_HOST_CHAR
+#pragma push_macro("IS_MARK")
+#undef IS_MARK
+#pragma push_macro("IS_NUM")
+#undef IS_NUM
+#pragma push_macro("IS_URL_CHAR")
+#undef IS_URL_CHAR
+#pragma push_macro("IS_USERINFO_CHAR")
+#undef IS_USERINFO_CHAR
+#pragma push_macro("KEEP_ALIVE")
+#undef KEEP_ALIVE
+#pragma push_macro("LE_MASK")
+#undef LE_MASK
+#pragma push_macro("LE_WORD")
+#undef LE_WORD
+#pragma push_macro("LF")
+#undef LF
+#pragma push_macro("LIKELY")
+#undef LIKELY
+#pragma push_macro("LOWER")
+#undef LOWER
+#pragma push_macro("MARK")
+#undef MARK
+#pragma push_macro("METHOD_ENTRY")
+#undef METHOD_ENTRY
+#pragma push_macro("MIN")
+#undef MIN
+#pragma push_macro("NEW_MESSAGE")
+#undef NEW_MESSAGE
+#pragma push_macro("PARSING_HEADER")
+#undef PARSING_HEADER
+#pragma push_macro("PREFETCH")
+#undef PREFETCH
+#pragma push_macro("PROBE2")
+#undef PROBE2
+#pragma push_macro("PROBE3")
+#undef PROBE3
+#pragma push_macro("PROXY_CONNECTION")
+#undef PROXY_CONNECTION
+#pragma push_macro("REEXECUTE")
+#undef REEXECUTE
+#pragma push_macro("RETURN")
+#undef RETURN
+#pragma push_macro("SET_ERRNO")
+#undef SET_ERRNO
+#pragma push_macro("SKIP_TO")
+#undef SKIP_TO
+#pragma push_macro("STATE_CASE")
+#undef STATE_CASE
+#pragma push_macro("STATE_DEFAULT")
+#undef STATE_DEFAULT
+#pragma push_macro("STATS_ADD")
+#undef STATS_ADD
+#pragma push_macro("STRICT_CHECK")
+#undef STRICT_CHECK
+#pragma push_macro("STRICT_TOKEN")
+#undef STRICT_TOKEN
+#pragma push_macro("TOKEN")
+#undef TOKEN
+#pragma push_macro("TRANSFER_ENCODING")
+#undef TRANSFER_ENCODING
+#pragma push_macro("UNLIKELY")
+#undef UNLIKELY
+#pragma push_macro("UPDATE_STATE")
+#undef UPDATE_STATE
+#pragma push_macro("UPGRADE")
+#undef UPGRADE
+#pragma push_macro("start_state")
+#undef start_state
+
+namespace http {
+
+namespace detail {
+
+#include "http_parser_internal.h"
+
+/* has_on_FOR<H> says whether H declares callback FOR and call_on_FOR()
+ * runs it, or returns 0 if it doesn't exist.
+ */
+#define HTTP_PARSER_HOOK(FOR, PARAMS, ARGS, DECLARGS)                \
+template <class H, class = void>                                     \
+struct has_on_##FOR : std::false_type {};                            \
+                                                                     \
+template <class H>                                                   \
+struct has_on_##FOR<H, std::void_t<decltype(                         \
+    std::declval<H &>().on_##FOR DECLARGS)>> : std::true_type {};    \
+                                                                     \
+template <class H>                                                   \
+inline int                                                           \
+call_on_##FOR PARAMS                                                 \
+{                                                                    \
+  if constexpr (!has_on_##FOR<H>::value) {                           \
+    (void) h;                                                        \
+    return 0;                                                        \
+  } else if constexpr (std::is_void_v<decltype(h.on_##FOR ARGS)>) {  \
+    h.on_##FOR ARGS;                                                 \
+    return 0;                                                        \
+  } else {                                                           \
+    return h.on_##FOR ARGS;                                          \
+  }                                                                  \
+}
+
+#define HTTP_PARSER_NOTIFY_HOOK(FOR)                                 \
+  HTTP_PARSER_HOOK(FOR, (H &h), (), ())
+#define HTTP_PARSER_DATA_HOOK(FOR)                                   \
+  HTTP_PARSER_HOOK(FOR, (H &h, const char *at, size_t length),       \
+                   (at, length),                                     \
+                   (std::declval<const char *>(), std::declval<size_t>()))
+
+HTTP_PARSER_NOTIFY_HOOK(message_begin)
+HTTP_PARSER_DATA_HOOK(url)
+HTTP_PARSER_DATA_HOOK(status)
+HTTP_PARSER_DATA_HOOK(header_field)
+HTTP_PARSER_DATA_HOOK(header_value)
+HTTP_PARSER_NOTIFY_HOOK(headers_complete)
+HTTP_PARSER_DATA_HOOK(body)
+HTTP_PARSER_NOTIFY_HOOK(message_complete)
+HTTP_PARSER_NOTIFY_HOOK(chunk_header)
+HTTP_PARSER_NOTIFY_HOOK(chunk_complete)
+
+#undef HTTP_PARSER_NOTIFY_HOOK
+#undef HTTP_PARSER_DATA_HOOK
+#undef HTTP_PARSER_HOOK
+
+template <class Handler>
+struct request_engine {
+#define EXECUTE_NAME execute
+#define EXECUTE_HEADER_BLOCK 0
+#define EXECUTE_SETTINGS Handler
+#define HAS_CALLBACK(FOR) (has_on_##FOR<Handler>::value)
+#define RUN_NOTIFY_CALLBACK(FOR) call_on_##FOR(*settings)
+#define RUN_DATA_CALLBACK(FOR, AT, LEN) call_on_##FOR(*settings, AT, LEN)
+#include "http_parser_engine.h"
+};
+
+template <class Handler>
+struct response_engine {
+#define EXECUTE_NAME execute
+#define EXECUTE_HEADER_BLOCK 0
+#define EXECUTE_RESPONSE 1
+#define EXECUTE_DETECT_NAME start_req_or_res
+#define EXECUTE_SETTINGS Handler
+#define HAS_CALLBACK(FOR) (has_on_##FOR<Handler>::value)
+#define RUN_NOTIFY_CALLBACK(FOR) call_on_##FOR(*settings)
+#define RUN_DATA_CALLBACK(FOR, AT, LEN) call_on_##FOR(*settings, AT, LEN)
+#include "http_parser_engine.h"
+};
+
+}  // namespace detail
+
+template <class Handler>
+class basic_parser {
+ public:
+  explicit basic_parser(enum http_parser_type type = HTTP_REQUEST) {
+    parser_.data = NULL;
+    http_parser_init(&parser_, type);
+  }
+
+  /* Starts over with a new stream, as http_parser_init() does */
+  void reset(enum http_parser_type type) {
+    http_parser_init(&parser_, type);
+  }
+
+  /* Same contract as http_parser_execute(); len == 0 signals EOF */
+  size_t execute(const char *data, size_t len) {
+    Handler *handler = static_cast<Handler *>(this);
+    size_t nparsed = 0;
+
+    if (parser_.type == HTTP_BOTH) {
+      nparsed = detail::response_engine<Handler>::start_req_or_res(
+          &parser_, handler, data, len);
+      if (parser_.type == HTTP_BOTH ||
+          HTTP_PARSER_ERRNO(&parser_) != HPE_OK) {
+        return nparsed;
+      }
+    }
+
+    if (parser_.type == HTTP_RESPONSE) {
+      return nparsed + detail::response_engine<Handler>::execute(
+          &parser_, handler, data + nparsed, len - nparsed);
+    }
+
+    return nparsed + detail::request_engine<Handler>::execute(
+        &parser_, handler, data + nparsed, len - nparsed);
+  }
+
+  void pause(bool paused) { http_parser_pause(&parser_, paused); }
+
+  enum http_errno error() const {
+    return HTTP_PARSER_ERRNO(&parser_);
+  }
+
+  http_parser &native() { return parser_; }
+  const http_parser &native() const { return parser_; }
+
+ protected:
+  ~basic_parser() = default;
+
+ private:
+  http_parser parser_;
+};
+
+}  // namespace http
+
+/* Drop the state machine's macros and restore the includer's */
+#undef ARRAY_SIZE
+#pragma pop_macro("ARRAY_SIZE")
+#undef BIT_AT
+#pragma pop_macro("BIT_AT")
+#undef CALLBACK_DATA
+#pragma pop_macro("CALLBACK_DATA")
+#undef CALLBACK_DATA_
+#pragma pop_macro("CALLBACK_DATA_")
+#undef CALLBACK_DATA_NOADVANCE
+#pragma pop_macro("CALLBACK_DATA_NOADVANCE")
+#undef CALLBACK_NOTIFY
+#pragma pop_macro("CALLBACK_NOTIFY")
+#undef CALLBACK_NOTIFY_
+#pragma pop_macro("CALLBACK_NOTIFY_")
+#undef CALLBACK_NOTIFY_NOADVANCE
+#pragma pop_macro("CALLBACK_NOTIFY_NOADVANCE")
+#undef CHUNKED
+#pragma pop_macro("CHUNKED")
+#undef CLOSE
+#pragma pop_macro("CLOSE")
+#undef CONNECTION
+#pragma pop_macro("CONNECTION")
+#undef CONTENT_LENGTH
+#pragma pop_macro("CONTENT_LENGTH")
+#undef CR
+#pragma pop_macro("CR")
+#undef CURRENT_STATE
+#pragma pop_macro("CURRENT_STATE")
+#undef ELEM_AT
+#pragma pop_macro("ELEM_AT")
+#undef FALLTHROUGH
+#pragma pop_macro("FALLTHROUGH")
+#undef HEADER_RUN_CHARGE
+#pragma pop_macro("HEADER_RUN_CHARGE")
+#undef HEADER_RUN_START
+#pragma pop_macro("HEADER_RUN_START")
+#undef IS_ALPHA
+#pragma pop_macro("IS_ALPHA")
+#undef IS_ALPHANUM
+#pragma pop_macro("IS_ALPHANUM")
+#undef IS_HEX
+#pragma pop_macro("IS_HEX")
+#undef IS_HOST_CHAR
+#pragma pop_macro("IS_HOST_CHAR")
+#undef IS_MARK
+#pragma pop_macro("IS_MARK")
+#undef IS_NUM
+#pragma pop_macro("IS_NUM")
+#undef IS_URL_CHAR
+#pragma pop_macro("IS_URL_CHAR")
+#undef IS_USERINFO_CHAR
+#pragma pop_macro("IS_USERINFO_CHAR")
+#undef KEEP_ALIVE
+#pragma pop_macro("KEEP_ALIVE")
+#undef LE_MASK
+#pragma pop_macro("LE_MASK")
+#undef LE_WORD
+#pragma pop_macro("LE_WORD")
+#undef LF
+#pragma pop_macro("LF")
+#undef LIKELY
+#pragma pop_macro("LIKELY")
+#undef LOWER
+#pragma pop_macro("LOWER")
+#undef MARK
+#pragma pop_macro("MARK")
+#undef METHOD_ENTRY
+#pragma pop_macro("METHOD_ENTRY")
+#undef MIN
+#pragma pop_macro("MIN")
+#undef NEW_MESSAGE
+#pragma pop_macro("NEW_MESSAGE")
+#undef PARSING_HEADER
+#pragma pop_macro("PARSING_HEADER")
+#undef PREFETCH
+#pragma pop_macro("PREFETCH")
+#undef PROBE2
+#pragma pop_macro("PROBE2")
+#undef PROBE3
+#pragma pop_macro("PROBE3")
+#undef PROXY_CONNECTION
+#pragma pop_macro("PROXY_CONNECTION")
+#undef REEXECUTE
+#pragma pop_macro("REEXECUTE")
+#undef RETURN
+#pragma pop_macro("RETURN")
+#undef SET_ERRNO
+#pragma pop_macro("SET_ERRNO")
+#undef SKIP_TO
+#pragma pop_macro("SKIP_TO")
+#undef STATE_CASE
+#pragma pop_macro("STATE_CASE")
+#undef STATE_DEFAULT
+#pragma pop_macro("STATE_DEFAULT")
+#undef STATS_ADD
+#pragma pop_macro("STATS_ADD")
+#undef STRICT_CHECK
+#pragma pop_macro("STRICT_CHECK")
+#undef STRICT_TOKEN
+#pragma pop_macro("STRICT_TOKEN")
+#undef TOKEN
+#pragma pop_macro("TOKEN")
+#undef TRANSFER_ENCODING
+#pragma pop_macro("TRANSFER_ENCODING")
+#undef UNLIKELY
+#pragma pop_macro("UNLIKELY")
+#undef UPDATE_STATE
+#pragma pop_macro("UPDATE_STATE")
+#undef UPGRADE
+#pragma pop_macro("UPGRADE")
+#undef start_state
+#pragma pop_macro("start_state")
+
+#endif
@@ -0,0 +1,1785 @@
+/* Based on src/http/ngx_http_parse.c from NGINX copyright Igor Sysoev
+ *
+ * Additional changes are licensed under the same terms as NGINX and
+ * copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* The state machine behind http_parser_execute().
+ *
+ * This is not a public header. http_parser.c and http_parser.hpp include it
+ * once for every engine they build, after defining
+ *
+ *   EXECUTE_NAME          name of the static function to generate
+ *   EXECUTE_HEADER_BLOCK  1 if `data` starts a request and `len` is too
+ *                         short for the head to overflow the header size
+ *                         limit; 0 otherwise
+ *
+ *   EXECUTE_RESPONSE      optional; 1 to parse status lines instead of
+ *                         request lines. Defaults to 0
+ *   EXECUTE_SETTINGS      optional; the type `settings` points to. When set,
+ *                         also define HAS_CALLBACK(FOR),
+ *                         RUN_NOTIFY_CALLBACK(FOR) and
+ *                         RUN_DATA_CALLBACK(FOR, AT, LEN) to say which
+ *                         callbacks exist and how to run them. The default
+ *                         is http_parser_settings and its function pointers.
+ *   EXECUTE_DETECT_NAME   optional; also generate the function that picks
+ *                         the request or response engine for HTTP_BOTH,
+ *                         under this name
+ *
+ * The header block engine skips the header size accounting and returns as
+ * soon as the head is done, leaving the body to the incremental engine.
+ * Everything else, callbacks and errors included, is shared.
+ */
+
+#ifndef EXECUTE_RESPONSE
+# define EXECUTE_RESPONSE 0
+#endif
+
+#ifndef EXECUTE_SETTINGS
+# define EXECUTE_SETTINGS const http_parser_settings
+# define HAS_CALLBACK(FOR) (settings->on_##FOR != NULL)
+# define RUN_NOTIFY_CALLBACK(FOR) settings->on_##FOR(parser)
+# define RUN_DATA_CALLBACK(FOR, AT, LEN) settings->on_##FOR(parser, AT, LEN)
+#endif
+
+static size_t
+EXECUTE_NAME (http_parser *parser,
+              EXECUTE_SETTINGS *settings,
+              const char *data,
+              size_t len)
+{
+  char c, ch;
+  int8_t unhex_val;
+  const char *p = data;
+  const char *p_end = data + len;
+  const char *header_run = NULL;
+  const char *header_field_mark = 0;
+  const char *header_value_mark = 0;
+  const char *url_mark = 0;
+  const char *body_mark = 0;
+  const char *status_mark = 0;
+  const char *header_name = 0;
+  enum state p_state = (enum state) parser->state;
+
+#if HTTP_PARSER_THREADED
+  /* Where each state starts in the big switch below; see STATE_CASE() */
+# define ANY_STATE(S) [S] = &&state_##S
+# define NO_STATE(S) [S] = &&state_default
+# if EXECUTE_RESPONSE
+#  define RESPONSE_STATE(S) ANY_STATE(S)
+#  define REQUEST_STATE(S) NO_STATE(S)
+# else
+#  define RESPONSE_STATE(S) NO_STATE(S)
+#  define REQUEST_STATE(S) ANY_STATE(S)
+# endif
+  static const void *const dispatch[] =
+    { NO_STATE(0)
+    , ANY_STATE(s_dead)
+    , NO_STATE(s_start_req_or_res)
+    , NO_STATE(s_res_or_resp_H)
+    , RESPONSE_STATE(s_start_res)
+    , RESPONSE_STATE(s_res_H)
+    , RESPONSE_STATE(s_res_HT)
+    , RESPONSE_STATE(s_res_HTT)
+    , RESPONSE_STATE(s_res_HTTP)
+    , RESPONSE_STATE(s_res_first_http_major)
+    , RESPONSE_STATE(s_res_http_major)
+    , RESPONSE_STATE(s_res_first_http_minor)
+    , RESPONSE_STATE(s_res_http_minor)
+    , RESPONSE_STATE(s_res_first_status_code)
+    , RESPONSE_STATE(s_res_status_code)
+    , RESPONSE_STATE(s_res_status_start)
+    , RESPONSE_STATE(s_res_status)
+    , RESPONSE_STATE(s_res_line_almost_done)
+    , REQUEST_STATE(s_start_req)
+    , REQUEST_STATE(s_req_method)
+    , REQUEST_STATE(s_req_spaces_before_url)
+    , REQUEST_STATE(s_req_schema)
+    , REQUEST_STATE(s_req_schema_slash)
+    , REQUEST_STATE(s_req_schema_slash_slash)
+    , REQUEST_STATE(s_req_server_start)
+    , REQUEST_STATE(s_req_server)
+    , REQUEST_STATE(s_req_server_with_at)
+    , REQUEST_STATE(s_req_path)
+    , REQUEST_STATE(s_req_query_string_start)
+    , REQUEST_STATE(s_req_query_string)
+    , REQUEST_STATE(s_req_fragment_start)
+    , REQUEST_STATE(s_req_fragment)
+    , REQUEST_STATE(s_req_http_start)
+    , REQUEST_STATE(s_req_http_H)
+    , REQUEST_STATE(s_req_http_HT)
+    , REQUEST_STATE(s_req_http_HTT)
+    , REQUEST_STATE(s_req_http_HTTP)
+    , REQUEST_STATE(s_req_first_http_major)
+    , REQUEST_STATE(s_req_http_major)
+    , REQUEST_STATE(s_req_first_http_minor)
+    , REQUEST_STATE(s_req_http_minor)
+    , REQUEST_STATE(s_req_line_almost_done)
+    , ANY_STATE(s_header_field_start)
+    , ANY_STATE(s_header_field)
+    , ANY_STATE(s_header_value_discard_ws)
+    , ANY_STATE(s_header_value_discard_ws_almost_done)
+    , ANY_STATE(s_header_value_discard_lws)
+    , ANY_STATE(s_header_value_start)
+    , ANY_STATE(s_header_value)
+    , ANY_STATE(s_header_value_lws)
+    , ANY_STATE(s_header_almost_done)
+    , ANY_STATE(s_chunk_size_start)
+    , ANY_STATE(s_chunk_size)
+    , ANY_STATE(s_chunk_parameters)
+    , ANY_STATE(s_chunk_size_almost_done)
+    , ANY_STATE(s_headers_almost_done)
+    , ANY_STATE(s_headers_done)
+    , ANY_STATE(s_chunk_data)
+    , ANY_STATE(s_chunk_data_almost_done)
+    , ANY_STATE(s_chunk_data_done)
+    , ANY_STATE(s_body_identity)
+    , ANY_STATE(s_body_identity_eof)
+    , ANY_STATE(s_message_done)
+    };
+# undef ANY_STATE
+# undef NO_STATE
+# undef RESPONSE_STATE
+# undef REQUEST_STATE
+#endif
+
+  /* We're in an error state. Don't bother doing anything. */
+  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+    return 0;
+  }
+
+  if (len == 0) {
+    switch (CURRENT_STATE()) {
+      case s_body_identity_eof:
+        /* Use of CALLBACK_NOTIFY() here would erroneously return 1 byte read if
+         * we got paused.
+         */
+        CALLBACK_NOTIFY_NOADVANCE(message_complete);
+        return 0;
+
+      case s_dead:
+      case start_state:
+        return 0;
+
+      default:
+        SET_ERRNO(HPE_INVALID_EOF_STATE);
+        return 1;
+    }
+  }
+
+
+  if (CURRENT_STATE() == s_header_field)
+    header_field_mark = data;
+  if (CURRENT_STATE() == s_header_value)
+    header_value_mark = data;
+#if EXECUTE_RESPONSE
+  if (CURRENT_STATE() == s_res_status)
+    status_mark = data;
+#else
+  switch (CURRENT_STATE()) {
+  case s_req_path:
+  case s_req_schema:
+  case s_req_schema_slash:
+  case s_req_schema_slash_slash:
+  case s_req_server_start:
+  case s_req_server:
+  case s_req_server_with_at:
+  case s_req_query_string_start:
+  case s_req_query_string:
+  case s_req_fragment_start:
+  case s_req_fragment:
+    url_mark = data;
+    break;
+  default:
+    break;
+  }
+#endif
+
+  HEADER_RUN_START(data);
+
+  for (p=data; p != p_end; p++) {
+    ch = *p;
+    STATS_ADD(bytes[CURRENT_STATE()], 1);
+
+reexecute:
+#if HTTP_PARSER_THREADED
+    goto *dispatch[CURRENT_STATE()];
+#endif
+    switch (CURRENT_STATE()) {
+
+      STATE_CASE(s_dead):
+        /* this state is used after a 'Connection: close' message
+         * the parser will error out if it reads another message
+         */
+        if (LIKELY(ch == CR || ch == LF))
+          break;
+
+        SET_ERRNO(HPE_CLOSED_CONNECTION);
+        goto error;
+
+#if EXECUTE_RESPONSE
+      STATE_CASE(s_start_res):
+      {
+        if (ch == CR || ch == LF)
+          break;
+        parser->flags = 0;
+        parser->content_length = ULLONG_MAX;
+
+        if (UNLIKELY(ch != 'H')) {
+          SET_ERRNO(HPE_INVALID_CONSTANT);
+          goto error;
+        }
+
+        /* "HTTP/1.x " in one piece; skip the per byte states */
+        if (p_end - p >= 9 &&
+            (load_le64(p) & LE_MASK(7)) ==
+              LE_WORD('H','T','T','P','/','1','.', 0) &&
+            IS_NUM(p[7]) && p[8] == ' ') {
+          parser->http_major = 1;
+          parser->http_minor = p[7] - '0';
+          SKIP_TO(p + 8);
+          UPDATE_STATE(s_res_first_status_code);
+
+          CALLBACK_NOTIFY(message_begin);
+          break;
+        }
+
+        UPDATE_STATE(s_res_H);
+
+        CALLBACK_NOTIFY(message_begin);
+        break;
+      }
+
+      STATE_CASE(s_res_H):
+        STRICT_CHECK(ch != 'T');
+        UPDATE_STATE(s_res_HT);
+        break;
+
+      STATE_CASE(s_res_HT):
+        STRICT_CHECK(ch != 'T');
+        UPDATE_STATE(s_res_HTT);
+        break;
+
+      STATE_CASE(s_res_HTT):
+        STRICT_CHECK(ch != 'P');
+        UPDATE_STATE(s_res_HTTP);
+        break;
+
+      STATE_CASE(s_res_HTTP):
+        STRICT_CHECK(ch != '/');
+        UPDATE_STATE(s_res_first_http_major);
+        break;
+
+      /* first digit of major HTTP version */
+      STATE_CASE(s_res_first_http_major):
+        if (UNLIKELY(ch < '0' || ch > '9')) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major = ch - '0';
+        UPDATE_STATE(s_res_http_major);
+        break;
+
+      /* major HTTP version or dot */
+      STATE_CASE(s_res_http_major):
+      {
+        if (ch == '.') {
+          UPDATE_STATE(s_res_first_http_minor);
+          break;
+        }
+
+        if (UNLIKELY(!IS_NUM(ch))) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major *= 10;
+        parser->http_major += ch - '0';
+
+        if (UNLIKELY(parser->http_major > 999)) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      /* first digit of minor HTTP version */
+      STATE_CASE(s_res_first_http_minor):
+        if (UNLIKELY(!IS_NUM(ch))) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor = ch - '0';
+        UPDATE_STATE(s_res_http_minor);
+        break;
+
+      /* minor HTTP version or end of version */
+      STATE_CASE(s_res_http_minor):
+      {
+        if (ch == ' ') {
+          UPDATE_STATE(s_res_first_status_code);
+          break;
+        }
+
+        if (UNLIKELY(!IS_NUM(ch))) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor *= 10;
+        parser->http_minor += ch - '0';
+
+        if (UNLIKELY(parser->http_minor > 999)) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      STATE_CASE(s_res_first_status_code):
+      {
+        if (!IS_NUM(ch)) {
+          if (ch == ' ') {
+            break;
+          }
+
+          SET_ERRNO(HPE_INVALID_STATUS);
+          goto error;
+        }
+        parser->status_code = ch - '0';
+        UPDATE_STATE(s_res_status_code);
+        break;
+      }
+
+      STATE_CASE(s_res_status_code):
+      {
+        if (!IS_NUM(ch)) {
+          switch (ch) {
+            case ' ':
+              UPDATE_STATE(s_res_status_start);
+              break;
+            case CR:
+              UPDATE_STATE(s_res_line_almost_done);
+              break;
+            case LF:
+              UPDATE_STATE(s_header_field_start);
+              break;
+            default:
+              SET_ERRNO(HPE_INVALID_STATUS);
+              goto error;
+          }
+          break;
+        }
+
+        parser->status_code *= 10;
+        parser->status_code += ch - '0';
+
+        if (UNLIKELY(parser->status_code > 999)) {
+          SET_ERRNO(HPE_INVALID_STATUS);
+          goto error;
+        }
+
+        break;
+      }
+
+      STATE_CASE(s_res_status_start):
+      {
+        if (ch == CR) {
+          UPDATE_STATE(s_res_line_almost_done);
+          break;
+        }
+
+        if (ch == LF) {
+          UPDATE_STATE(s_header_field_start);
+          break;
+        }
+
+        MARK(status);
+        UPDATE_STATE(s_res_status);
+        parser->index = 0;
+        break;
+      }
+
+      STATE_CASE(s_res_status):
+        if (ch == CR) {
+          UPDATE_STATE(s_res_line_almost_done);
+          CALLBACK_DATA(status);
+          break;
+        }
+
+        if (ch == LF) {
+          UPDATE_STATE(s_header_field_start);
+          CALLBACK_DATA(status);
+          break;
+        }
+
+        break;
+
+      STATE_CASE(s_res_line_almost_done):
+        STRICT_CHECK(ch != LF);
+        UPDATE_STATE(s_header_field_start);
+        break;
+
+#else
+      STATE_CASE(s_start_req):
+      {
+        if (ch == CR || ch == LF)
+          break;
+        parser->flags = 0;
+        parser->content_length = ULLONG_MAX;
+
+        if (UNLIKELY(!IS_ALPHA(ch))) {
+          SET_ERRNO(HPE_INVALID_METHOD);
+          goto error;
+        }
+
+        /* Whole method and the space after it in one compare */
+        if (p_end - p >= 8) {
+          uint64_t word = load_le64(p);
+          unsigned int i;
+
+          for (i = 0; i < ARRAY_SIZE(method_words); i++) {
+            if ((word & method_words[i].mask) == method_words[i].word) {
+              break;
+            }
+          }
+
+          if (i < ARRAY_SIZE(method_words)) {
+            parser->method = (enum http_method) method_words[i].method;
+            SKIP_TO(p + method_words[i].len - 1);
+            UPDATE_STATE(s_req_spaces_before_url);
+
+            CALLBACK_NOTIFY(message_begin);
+            break;
+          }
+        }
+
+        parser->method = (enum http_method) 0;
+        parser->index = 1;
+        switch (ch) {
+          case 'C': parser->method = HTTP_CONNECT; /* or COPY, CHECKOUT */ break;
+          case 'D': parser->method = HTTP_DELETE; break;
+          case 'G': parser->method = HTTP_GET; break;
+          case 'H': parser->method = HTTP_HEAD; break;
+          case 'L': parser->method = HTTP_LOCK; break;
+          case 'M': parser->method = HTTP_MKCOL; /* or MOVE, MKACTIVITY, MERGE, M-SEARCH, MKCALENDAR */ break;
+          case 'N': parser->method = HTTP_NOTIFY; break;
+          case 'O': parser->method = HTTP_OPTIONS; break;
+          case 'P': parser->method = HTTP_POST;
+            /* or PROPFIND|PROPPATCH|PUT|PATCH|PURGE */
+            break;
+          case 'R': parser->method = HTTP_REPORT; break;
+          case 'S': parser->method = HTTP_SUBSCRIBE; /* or SEARCH */ break;
+          case 'T': parser->method = HTTP_TRACE; break;
+          case 'U': parser->method = HTTP_UNLOCK; /* or UNSUBSCRIBE */ break;
+          default:
+            SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+        }
+        UPDATE_STATE(s_req_method);
+
+        CALLBACK_NOTIFY(message_begin);
+
+        break;
+      }
+
+      STATE_CASE(s_req_method):
+      {
+        const char *matcher;
+        if (UNLIKELY(ch == '\0')) {
+          SET_ERRNO(HPE_INVALID_METHOD);
+          goto error;
+        }
+
+        matcher = method_strings[parser->method];
+        if (ch == ' ' && matcher[parser->index] == '\0') {
+          UPDATE_STATE(s_req_spaces_before_url);
+        } else if (ch == matcher[parser->index]) {
+          ; /* nada */
+        } else if (parser->method == HTTP_CONNECT) {
+          if (parser->index == 1 && ch == 'H') {
+            parser->method = HTTP_CHECKOUT;
+          } else if (parser->index == 2  && ch == 'P') {
+            parser->method = HTTP_COPY;
+          } else {
+            SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->method == HTTP_MKCOL) {
+          if (parser->index == 1 && ch == 'O') {
+            parser->method = HTTP_MOVE;
+          } else if (parser->index == 1 && ch == 'E') {
+            parser->method = HTTP_MERGE;
+          } else if (parser->index == 1 && ch == '-') {
+            parser->method = HTTP_MSEARCH;
+          } else if (parser->index == 2 && ch == 'A') {
+            parser->method = HTTP_MKACTIVITY;
+          } else if (parser->index == 3 && ch == 'A') {
+            parser->method = HTTP_MKCALENDAR;
+          } else {
+            SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->method == HTTP_SUBSCRIBE) {
+          if (parser->index == 1 && ch == 'E') {
+            parser->method = HTTP_SEARCH;
+          } else {
+            SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->index == 1 && parser->method == HTTP_POST) {
+          if (ch == 'R') {
+            parser->method = HTTP_PROPFIND; /* or HTTP_PROPPATCH */
+          } else if (ch == 'U') {
+            parser->method = HTTP_PUT; /* or HTTP_PURGE */
+          } else if (ch == 'A') {
+            parser->method = HTTP_PATCH;
+          } else {
+            SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->index == 2) {
+          if (parser->method == HTTP_PUT) {
+            if (ch == 'R') {
+              parser->method = HTTP_PURGE;
+            } else {
+              SET_ERRNO(HPE_INVALID_METHOD);
+              goto error;
+            }
+          } else if (parser->method == HTTP_UNLOCK) {
+            if (ch == 'S') {
+              parser->method = HTTP_UNSUBSCRIBE;
+            } else {
+              SET_ERRNO(HPE_INVALID_METHOD);
+              goto error;
+            }
+          } else {
+            SET_ERRNO(HPE_INVALID_METHOD);
+            goto error;
+          }
+        } else if (parser->index == 4 && parser->method == HTTP_PROPFIND && ch == 'P') {
+          parser->method = HTTP_PROPPATCH;
+        } else {
+          SET_ERRNO(HPE_INVALID_METHOD);
+          goto error;
+        }
+
+        ++parser->index;
+        break;
+      }
+
+      STATE_CASE(s_req_spaces_before_url):
+      {
+        if (ch == ' ') break;
+
+        MARK(url);
+        if (parser->method == HTTP_CONNECT) {
+          UPDATE_STATE(s_req_server_start);
+        }
+
+        UPDATE_STATE(parse_url_char(CURRENT_STATE(), ch));
+        if (UNLIKELY(CURRENT_STATE() == s_dead)) {
+          SET_ERRNO(HPE_INVALID_URL);
+          goto error;
+        }
+
+        break;
+      }
+
+      STATE_CASE(s_req_schema):
+      STATE_CASE(s_req_schema_slash):
+      STATE_CASE(s_req_schema_slash_slash):
+      STATE_CASE(s_req_server_start):
+      {
+        switch (ch) {
+          /* No whitespace allowed here */
+          case ' ':
+          case CR:
+          case LF:
+            SET_ERRNO(HPE_INVALID_URL);
+            goto error;
+          default:
+            UPDATE_STATE(parse_url_char(CURRENT_STATE(), ch));
+            if (UNLIKELY(CURRENT_STATE() == s_dead)) {
+              SET_ERRNO(HPE_INVALID_URL);
+              goto error;
+            }
+        }
+
+        break;
+      }
+
+      STATE_CASE(s_req_server):
+      STATE_CASE(s_req_server_with_at):
+      STATE_CASE(s_req_path):
+      STATE_CASE(s_req_query_string_start):
+      STATE_CASE(s_req_query_string):
+      STATE_CASE(s_req_fragment_start):
+      STATE_CASE(s_req_fragment):
+      {
+        switch (ch) {
+          case ' ':
+            UPDATE_STATE(s_req_http_start);
+            CALLBACK_DATA(url);
+            break;
+          case CR:
+          case LF:
+            parser->http_major = 0;
+            parser->http_minor = 9;
+            UPDATE_STATE((ch == CR) ?
+              s_req_line_almost_done :
+              s_header_field_start);
+            CALLBACK_DATA(url);
+            break;
+          default:
+            UPDATE_STATE(parse_url_char(CURRENT_STATE(), ch));
+            if (UNLIKELY(CURRENT_STATE() == s_dead)) {
+              SET_ERRNO(HPE_INVALID_URL);
+              goto error;
+            }
+
+            /* Path and query string bytes don't change the state; skip
+             * them in bulk, up to p_end like the main loop.
+             */
+            if (CURRENT_STATE() == s_req_path ||
+                CURRENT_STATE() == s_req_query_string) {
+              SKIP_TO(find_url_delimiter(p + 1, p_end) - 1);
+            }
+        }
+        break;
+      }
+
+      STATE_CASE(s_req_http_start):
+        switch (ch) {
+          case 'H':
+            /* "HTTP/1.x\r\n" in one piece; skip the per byte states */
+            if (p_end - p >= 10 &&
+                (load_le64(p) & LE_MASK(7)) ==
+                  LE_WORD('H','T','T','P','/','1','.', 0) &&
+                IS_NUM(p[7]) && p[8] == CR && p[9] == LF) {
+              parser->http_major = 1;
+              parser->http_minor = p[7] - '0';
+              SKIP_TO(p + 9);
+              UPDATE_STATE(s_header_field_start);
+              break;
+            }
+
+            UPDATE_STATE(s_req_http_H);
+            break;
+          case ' ':
+            break;
+          default:
+            SET_ERRNO(HPE_INVALID_CONSTANT);
+            goto error;
+        }
+        break;
+
+      STATE_CASE(s_req_http_H):
+        STRICT_CHECK(ch != 'T');
+        UPDATE_STATE(s_req_http_HT);
+        break;
+
+      STATE_CASE(s_req_http_HT):
+        STRICT_CHECK(ch != 'T');
+        UPDATE_STATE(s_req_http_HTT);
+        break;
+
+      STATE_CASE(s_req_http_HTT):
+        STRICT_CHECK(ch != 'P');
+        UPDATE_STATE(s_req_http_HTTP);
+        break;
+
+      STATE_CASE(s_req_http_HTTP):
+        STRICT_CHECK(ch != '/');
+        UPDATE_STATE(s_req_first_http_major);
+        break;
+
+      /* first digit of major HTTP version */
+      STATE_CASE(s_req_first_http_major):
+        if (UNLIKELY(ch < '1' || ch > '9')) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major = ch - '0';
+        UPDATE_STATE(s_req_http_major);
+        break;
+
+      /* major HTTP version or dot */
+      STATE_CASE(s_req_http_major):
+      {
+        if (ch == '.') {
+          UPDATE_STATE(s_req_first_http_minor);
+          break;
+        }
+
+        if (UNLIKELY(!IS_NUM(ch))) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_major *= 10;
+        parser->http_major += ch - '0';
+
+        if (UNLIKELY(parser->http_major > 999)) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      /* first digit of minor HTTP version */
+      STATE_CASE(s_req_first_http_minor):
+        if (UNLIKELY(!IS_NUM(ch))) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor = ch - '0';
+        UPDATE_STATE(s_req_http_minor);
+        break;
+
+      /* minor HTTP version or end of request line */
+      STATE_CASE(s_req_http_minor):
+      {
+        if (ch == CR) {
+          UPDATE_STATE(s_req_line_almost_done);
+          break;
+        }
+
+        if (ch == LF) {
+          UPDATE_STATE(s_header_field_start);
+          break;
+        }
+
+        /* XXX allow spaces after digit? */
+
+        if (UNLIKELY(!IS_NUM(ch))) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        parser->http_minor *= 10;
+        parser->http_minor += ch - '0';
+
+        if (UNLIKELY(parser->http_minor > 999)) {
+          SET_ERRNO(HPE_INVALID_VERSION);
+          goto error;
+        }
+
+        break;
+      }
+
+      /* end of request line */
+      STATE_CASE(s_req_line_almost_done):
+      {
+        if (UNLIKELY(ch != LF)) {
+          SET_ERRNO(HPE_LF_EXPECTED);
+          goto error;
+        }
+
+        UPDATE_STATE(s_header_field_start);
+        break;
+      }
+
+#endif
+
+      STATE_CASE(s_header_field_start):
+      {
+        if (ch == CR) {
+          UPDATE_STATE(s_headers_almost_done);
+          break;
+        }
+
+        if (ch == LF) {
+          /* they might be just sending \n instead of \r\n so this would be
+           * the second \n to denote the end of headers*/
+          UPDATE_STATE(s_headers_almost_done);
+          REEXECUTE();
+        }
+
+        c = TOKEN(ch);
+
+        if (UNLIKELY(!c)) {
+          SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+          goto error;
+        }
+
+        MARK(header_field);
+        header_name = p;
+
+        parser->index = 0;
+        UPDATE_STATE(s_header_field);
+
+        switch (c) {
+          case 'c':
+            parser->header_state = h_C;
+            break;
+
+          case 'p':
+            parser->header_state = h_matching_proxy_connection;
+            break;
+
+          case 't':
+            parser->header_state = h_matching_transfer_encoding;
+            break;
+
+          case 'u':
+            parser->header_state = h_matching_upgrade;
+            break;
+
+          default:
+            parser->header_state = h_general;
+            break;
+        }
+        break;
+      }
+
+      STATE_CASE(s_header_field):
+      {
+        for (; p != p_end; p++) {
+          ch = *p;
+          c = TOKEN(ch);
+
+          if (!c)
+            break;
+
+          switch (parser->header_state) {
+            case h_general:
+              /* Not a header we care about; skip the rest of the name in
+               * bulk. The loop increment moves p onto the first byte that
+               * still needs the byte-wise checks (usually the ':').
+               */
+              SKIP_TO(find_non_token(p + 1, p_end) - 1);
+              break;
+
+            case h_C:
+              parser->index++;
+              parser->header_state = (c == 'o' ? h_CO : h_general);
+              break;
+
+            case h_CO:
+              parser->index++;
+              parser->header_state = (c == 'n' ? h_CON : h_general);
+              break;
+
+            case h_CON:
+              parser->index++;
+              switch (c) {
+                case 'n':
+                  parser->header_state = h_matching_connection;
+                  break;
+                case 't':
+                  parser->header_state = h_matching_content_length;
+                  break;
+                default:
+                  parser->header_state = h_general;
+                  break;
+              }
+              break;
+
+            /* connection */
+
+            case h_matching_connection:
+              parser->index++;
+              if (parser->index > sizeof(CONNECTION)-1
+                  || c != CONNECTION[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CONNECTION)-2) {
+                parser->header_state = h_connection;
+              }
+              break;
+
+            /* proxy-connection */
+
+            case h_matching_proxy_connection:
+              parser->index++;
+              if (parser->index > sizeof(PROXY_CONNECTION)-1
+                  || c != PROXY_CONNECTION[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(PROXY_CONNECTION)-2) {
+                parser->header_state = h_connection;
+              }
+              break;
+
+            /* content-length */
+
+            case h_matching_content_length:
+              parser->index++;
+              if (parser->index > sizeof(CONTENT_LENGTH)-1
+                  || c != CONTENT_LENGTH[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(CONTENT_LENGTH)-2) {
+                parser->header_state = h_content_length;
+              }
+              break;
+
+            /* transfer-encoding */
+
+            case h_matching_transfer_encoding:
+              parser->index++;
+              if (parser->index > sizeof(TRANSFER_ENCODING)-1
+                  || c != TRANSFER_ENCODING[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(TRANSFER_ENCODING)-2) {
+                parser->header_state = h_transfer_encoding;
+              }
+              break;
+
+            /* upgrade */
+
+            case h_matching_upgrade:
+              parser->index++;
+              if (parser->index > sizeof(UPGRADE)-1
+                  || c != UPGRADE[parser->index]) {
+                parser->header_state = h_general;
+              } else if (parser->index == sizeof(UPGRADE)-2) {
+                parser->header_state = h_upgrade;
+              }
+              break;
+
+            case h_connection:
+            case h_content_length:
+            case h_transfer_encoding:
+            case h_upgrade:
+              if (ch != ' ') parser->header_state = h_general;
+              break;
+
+            default:
+              assert(0 && "Unknown header_state");
+              break;
+          }
+        }
+
+        if (p == p_end) {
+          --p;
+          break;
+        }
+
+        if (ch == ':') {
+          if (header_name) {
+            parser->header_id =
+              header_id_lookup(header_field_mark, p - header_field_mark);
+            header_name = 0;
+          } else {
+            header_id_feed(parser, header_field_mark, p - header_field_mark);
+            parser->header_id = header_id_finish(parser);
+          }
+          UPDATE_STATE(s_header_value_discard_ws);
+          CALLBACK_DATA(header_field);
+          break;
+        }
+
+        SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+        goto error;
+      }
+
+      STATE_CASE(s_header_value_discard_ws):
+        if (ch == ' ' || ch == '\t') break;
+
+        if (ch == CR) {
+          UPDATE_STATE(s_header_value_discard_ws_almost_done);
+          break;
+        }
+
+        if (ch == LF) {
+          UPDATE_STATE(s_header_value_discard_lws);
+          break;
+        }
+
+        FALLTHROUGH;
+
+      STATE_CASE(s_header_value_start):
+      {
+        MARK(header_value);
+
+        UPDATE_STATE(s_header_value);
+        parser->index = 0;
+
+        c = LOWER(ch);
+
+        switch (parser->header_state) {
+          case h_upgrade:
+            parser->flags |= F_UPGRADE;
+            parser->header_state = h_general;
+            break;
+
+          case h_transfer_encoding:
+            /* looking for 'Transfer-Encoding: chunked' */
+            if ('c' == c) {
+              parser->header_state = h_matching_transfer_encoding_chunked;
+            } else {
+              parser->header_state = h_general;
+            }
+            break;
+
+          case h_content_length:
+          {
+            uint64_t value;
+            size_t n;
+
+            if (UNLIKELY(!IS_NUM(ch))) {
+              SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              goto error;
+            }
+
+            /* Usually the whole number is here; s_header_value checks
+             * the byte after it
+             */
+            n = parse_decimal(p, p_end, &value);
+            if (LIKELY(n > 0)) {
+              parser->content_length = value;
+              SKIP_TO(p + n - 1);
+              break;
+            }
+
+            parser->content_length = ch - '0';
+            break;
+          }
+
+          case h_connection:
+            /* looking for 'Connection: keep-alive' */
+            if (c == 'k') {
+              parser->header_state = h_matching_connection_keep_alive;
+            /* looking for 'Connection: close' */
+            } else if (c == 'c') {
+              parser->header_state = h_matching_connection_close;
+            } else if (c == 'u') {
+              parser->header_state = h_matching_connection_upgrade;
+            } else {
+              parser->header_state = h_matching_connection_token;
+            }
+            break;
+
+          /* Multi-value `Connection` header */
+          case h_matching_connection_token_start:
+            break;
+
+          default:
+            parser->header_state = h_general;
+            break;
+        }
+        break;
+      }
+
+      STATE_CASE(s_header_value):
+      {
+        enum header_states h_state = (enum header_states) parser->header_state;
+        for (; p != p_end; p++) {
+          ch = *p;
+          if (ch == CR) {
+            UPDATE_STATE(s_header_almost_done);
+            parser->header_state = h_state;
+            CALLBACK_DATA(header_value);
+            break;
+          }
+
+          if (ch == LF) {
+            UPDATE_STATE(s_header_almost_done);
+            parser->header_state = h_state;
+            CALLBACK_DATA_NOADVANCE(header_value);
+            REEXECUTE();
+          }
+
+          c = LOWER(ch);
+
+          switch (h_state) {
+            case h_general:
+              SKIP_TO(find_crlf(p, p_end) - 1);
+              break;
+
+            case h_connection:
+            case h_transfer_encoding:
+              assert(0 && "Shouldn't get here.");
+              break;
+
+            case h_content_length:
+            {
+              uint64_t t;
+
+              if (ch == ' ') break;
+
+              if (UNLIKELY(!IS_NUM(ch))) {
+                SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+                parser->header_state = h_state;
+                goto error;
+              }
+
+              t = parser->content_length;
+              t *= 10;
+              t += ch - '0';
+
+              /* Overflow? Test against a conservative limit for simplicity. */
+              if (UNLIKELY((ULLONG_MAX - 10) / 10 < parser->content_length)) {
+                SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+                parser->header_state = h_state;
+                goto error;
+              }
+
+              parser->content_length = t;
+              break;
+            }
+
+            /* Transfer-Encoding: chunked */
+            case h_matching_transfer_encoding_chunked:
+              parser->index++;
+              if (parser->index > sizeof(CHUNKED)-1
+                  || c != CHUNKED[parser->index]) {
+                h_state = h_general;
+              } else if (parser->index == sizeof(CHUNKED)-2) {
+                h_state = h_transfer_encoding_chunked;
+              }
+              break;
+
+            case h_matching_connection_token_start:
+              /* looking for 'Connection: keep-alive' */
+              if (c == 'k') {
+                h_state = h_matching_connection_keep_alive;
+              /* looking for 'Connection: close' */
+              } else if (c == 'c') {
+                h_state = h_matching_connection_close;
+              } else if (c == 'u') {
+                h_state = h_matching_connection_upgrade;
+              } else if (STRICT_TOKEN(c)) {
+                h_state = h_matching_connection_token;
+              } else if (c == ' ' || c == '\t') {
+                /* Skip lws */
+              } else {
+                h_state = h_general;
+              }
+              break;
+
+            /* looking for 'Connection: keep-alive' */
+            case h_matching_connection_keep_alive:
+              parser->index++;
+              if (parser->index > sizeof(KEEP_ALIVE)-1
+                  || c != KEEP_ALIVE[parser->index]) {
+                h_state = h_matching_connection_token;
+              } else if (parser->index == sizeof(KEEP_ALIVE)-2) {
+                h_state = h_connection_keep_alive;
+              }
+              break;
+
+            /* looking for 'Connection: close' */
+            case h_matching_connection_close:
+              parser->index++;
+              if (parser->index > sizeof(CLOSE)-1 || c != CLOSE[parser->index]) {
+                h_state = h_matching_connection_token;
+              } else if (parser->index == sizeof(CLOSE)-2) {
+                h_state = h_connection_close;
+              }
+              break;
+
+            /* looking for 'Connection: upgrade' */
+            case h_matching_connection_upgrade:
+              parser->index++;
+              if (parser->index > sizeof(UPGRADE) - 1 ||
+                  c != UPGRADE[parser->index]) {
+                h_state = h_matching_connection_token;
+              } else if (parser->index == sizeof(UPGRADE)-2) {
+                h_state = h_connection_upgrade;
+              }
+              break;
+
+            case h_matching_connection_token:
+              if (ch == ',') {
+                h_state = h_matching_connection_token_start;
+                parser->index = 0;
+              }
+              break;
+
+            case h_transfer_encoding_chunked:
+              if (ch != ' ') h_state = h_general;
+              break;
+
+            case h_connection_keep_alive:
+            case h_connection_close:
+            case h_connection_upgrade:
+              if (ch == ',') {
+                if (h_state == h_connection_keep_alive) {
+                  parser->flags |= F_CONNECTION_KEEP_ALIVE;
+                } else if (h_state == h_connection_close) {
+                  parser->flags |= F_CONNECTION_CLOSE;
+                } else if (h_state == h_connection_upgrade) {
+                  parser->flags |= F_CONNECTION_UPGRADE;
+                }
+                h_state = h_matching_connection_token_start;
+                parser->index = 0;
+              } else if (ch != ' ') {
+                h_state = h_matching_connection_token;
+              }
+              break;
+
+            default:
+              UPDATE_STATE(s_header_value);
+              h_state = h_general;
+              break;
+          }
+        }
+        parser->header_state = h_state;
+
+        if (p == p_end)
+          --p;
+        break;
+      }
+
+      STATE_CASE(s_header_almost_done):
+      {
+        STRICT_CHECK(ch != LF);
+
+        UPDATE_STATE(s_header_value_lws);
+        break;
+      }
+
+      STATE_CASE(s_header_value_lws):
+      {
+        if (ch == ' ' || ch == '\t') {
+          UPDATE_STATE(s_header_value_start);
+          REEXECUTE();
+        }
+
+        /* finished the header */
+        switch (parser->header_state) {
+          case h_connection_keep_alive:
+            parser->flags |= F_CONNECTION_KEEP_ALIVE;
+            break;
+          case h_connection_close:
+            parser->flags |= F_CONNECTION_CLOSE;
+            break;
+          case h_transfer_encoding_chunked:
+            parser->flags |= F_CHUNKED;
+            break;
+          case h_connection_upgrade:
+            parser->flags |= F_CONNECTION_UPGRADE;
+            break;
+          default:
+            break;
+        }
+
+        UPDATE_STATE(s_header_field_start);
+        REEXECUTE();
+      }
+
+      STATE_CASE(s_header_value_discard_ws_almost_done):
+      {
+        STRICT_CHECK(ch != LF);
+        UPDATE_STATE(s_header_value_discard_lws);
+        break;
+      }
+
+      STATE_CASE(s_header_value_discard_lws):
+      {
+        if (ch == ' ' || ch == '\t') {
+          UPDATE_STATE(s_header_value_discard_ws);
+          break;
+        } else {
+          switch (parser->header_state) {
+            case h_connection_keep_alive:
+              parser->flags |= F_CONNECTION_KEEP_ALIVE;
+              break;
+            case h_connection_close:
+              parser->flags |= F_CONNECTION_CLOSE;
+              break;
+            case h_connection_upgrade:
+              parser->flags |= F_CONNECTION_UPGRADE;
+              break;
+            case h_transfer_encoding_chunked:
+              parser->flags |= F_CHUNKED;
+              break;
+            default:
+              break;
+          }
+
+          /* header value was empty */
+          MARK(header_value);
+          UPDATE_STATE(s_header_field_start);
+          CALLBACK_DATA_NOADVANCE(header_value);
+          REEXECUTE();
+        }
+      }
+
+      STATE_CASE(s_headers_almost_done):
+      {
+        STRICT_CHECK(ch != LF);
+
+        if (parser->flags & F_TRAILING) {
+          /* End of a chunked request. The trailers count towards the head
+           * of the next message.
+           */
+          HEADER_RUN_CHARGE(p + 1);
+          UPDATE_STATE(s_message_done);
+          CALLBACK_NOTIFY_NOADVANCE(chunk_complete);
+          REEXECUTE();
+        }
+
+        UPDATE_STATE(s_headers_done);
+
+        /* Set this here so that on_headers_complete() callbacks can see it */
+        parser->upgrade =
+          ((parser->flags & (F_UPGRADE | F_CONNECTION_UPGRADE)) ==
+           (F_UPGRADE | F_CONNECTION_UPGRADE) ||
+           parser->method == HTTP_CONNECT);
+
+        /* Here we call the headers_complete callback. This is somewhat
+         * different than other callbacks because if the user returns 1, we
+         * will interpret that as saying that this message has no body. This
+         * is needed for the annoying case of recieving a response to a HEAD
+         * request.
+         *
+         * We'd like to use CALLBACK_NOTIFY_NOADVANCE() here but we cannot, so
+         * we have to simulate it by handling a change in errno below.
+         */
+        PROBE3(headers_complete, parser, p - data, parser->content_length);
+        if (HAS_CALLBACK(headers_complete)) {
+          STATS_ADD(callbacks[HPE_CB_headers_complete - HPE_CB_message_begin],
+                    1);
+          switch (RUN_NOTIFY_CALLBACK(headers_complete)) {
+            case 0:
+              break;
+
+            case 1:
+              parser->flags |= F_SKIPBODY;
+              break;
+
+            default:
+              SET_ERRNO(HPE_CB_headers_complete);
+              RETURN(p - data); /* Error */
+          }
+        }
+
+        if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+          RETURN(p - data);
+        }
+
+        REEXECUTE();
+      }
+
+      STATE_CASE(s_headers_done):
+      {
+        STRICT_CHECK(ch != LF);
+
+        parser->nread = 0;
+        HEADER_RUN_START(p + 1);
+
+#if EXECUTE_RESPONSE
+        /* 1xx, 204 and 304 responses never have a body, whatever their
+         * headers say (RFC 7230 section 3.3.3).
+         */
+        if (parser->status_code / 100 == 1 ||
+            parser->status_code == 204 ||
+            parser->status_code == 304) {
+          parser->flags |= F_SKIPBODY;
+        }
+#endif
+
+        int hasBody = parser->flags & F_CHUNKED ||
+          (parser->content_length > 0 && parser->content_length != ULLONG_MAX);
+        if (parser->upgrade && (parser->method == HTTP_CONNECT ||
+                                (parser->flags & F_SKIPBODY) || !hasBody)) {
+          /* Exit, the rest of the message is in a different protocol. */
+          UPDATE_STATE(NEW_MESSAGE());
+          CALLBACK_NOTIFY(message_complete);
+          RETURN((p - data) + 1);
+        }
+
+        if (parser->flags & F_SKIPBODY) {
+          UPDATE_STATE(NEW_MESSAGE());
+          CALLBACK_NOTIFY(message_complete);
+        } else if (parser->flags & F_CHUNKED) {
+          /* chunked encoding - ignore Content-Length header */
+          UPDATE_STATE(s_chunk_size_start);
+        } else {
+          if (parser->content_length == 0) {
+            /* Content-Length header given but zero: Content-Length: 0\r\n */
+            UPDATE_STATE(NEW_MESSAGE());
+            CALLBACK_NOTIFY(message_complete);
+          } else if (parser->content_length != ULLONG_MAX) {
+            /* Content-Length header given and non-zero */
+            UPDATE_STATE(s_body_identity);
+          } else {
+            if (!http_message_needs_eof(parser)) {
+              /* Assume content-length 0 - read the next */
+              UPDATE_STATE(NEW_MESSAGE());
+              CALLBACK_NOTIFY(message_complete);
+            } else {
+              /* Read body until EOF */
+              UPDATE_STATE(s_body_identity_eof);
+            }
+          }
+        }
+
+        if (EXECUTE_HEADER_BLOCK) {
+          /* The rest of the buffer belongs to the incremental engine */
+          RETURN((p - data) + 1);
+        }
+
+        /* On to the body, or the next message */
+        HEADER_RUN_START(p + 1);
+        break;
+      }
+
+      STATE_CASE(s_body_identity):
+      {
+        uint64_t to_read = MIN(parser->content_length,
+                               (uint64_t) ((data + len) - p));
+
+        assert(parser->content_length != 0
+            && parser->content_length != ULLONG_MAX);
+
+        /* The difference between advancing content_length and p is because
+         * the latter will automaticaly advance on the next loop iteration.
+         * Further, if content_length ends up at 0, we want to see the last
+         * byte again for our message complete callback.
+         */
+        MARK(body);
+        parser->content_length -= to_read;
+        SKIP_TO(p + to_read - 1);
+
+        if (parser->content_length == 0) {
+          UPDATE_STATE(s_message_done);
+
+          /* Mimic CALLBACK_DATA_NOADVANCE() but with one extra byte.
+           *
+           * The alternative to doing this is to wait for the next byte to
+           * trigger the data callback, just as in every other case. The
+           * problem with this is that this makes it difficult for the test
+           * harness to distinguish between complete-on-EOF and
+           * complete-on-length. It's not clear that this distinction is
+           * important for applications, but let's keep it for now.
+           */
+          CALLBACK_DATA_(body, p - body_mark + 1, p - data);
+          REEXECUTE();
+        }
+
+        break;
+      }
+
+      /* read until EOF */
+      STATE_CASE(s_body_identity_eof):
+        MARK(body);
+        SKIP_TO(data + len - 1);
+
+        break;
+
+      STATE_CASE(s_message_done):
+        UPDATE_STATE(NEW_MESSAGE());
+        HEADER_RUN_START(p + 1);
+        CALLBACK_NOTIFY(message_complete);
+        if (parser->upgrade) {
+          /* Exit, the rest of the message is in a different protocol. */
+          RETURN((p - data) + 1);
+        }
+        break;
+
+      STATE_CASE(s_chunk_size_start):
+      {
+        uint64_t size;
+        unsigned int n;
+
+        assert(EXECUTE_HEADER_BLOCK ||
+               (parser->nread == 0 && header_run == p));
+        assert(parser->flags & F_CHUNKED);
+
+        /* "<hex>\r\n" or "<hex>;<extensions>\r\n" in one piece; go
+         * straight to the LF. Longer sizes and anything unusual take the
+         * byte-wise states.
+         */
+        if (p_end - p >= 8 &&
+            (n = hex_le64(load_le64(p), &size)) > 0 && n < 8) {
+          const char *eol = p + n;
+
+          if (*eol == ';' || *eol == ' ') {
+            eol = find_crlf(eol, p_end);
+          }
+
+          if (p_end - eol >= 2 && eol[0] == CR && eol[1] == LF) {
+            parser->content_length = size;
+            SKIP_TO(eol + 1);
+            ch = *p;
+            UPDATE_STATE(s_chunk_size_almost_done);
+            REEXECUTE();
+          }
+        }
+
+        unhex_val = unhex[(unsigned char)ch];
+        if (UNLIKELY(unhex_val == -1)) {
+          SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
+          goto error;
+        }
+
+        parser->content_length = unhex_val;
+        UPDATE_STATE(s_chunk_size);
+        break;
+      }
+
+      STATE_CASE(s_chunk_size):
+      {
+        uint64_t t;
+
+        assert(parser->flags & F_CHUNKED);
+
+        if (ch == CR) {
+          UPDATE_STATE(s_chunk_size_almost_done);
+          break;
+        }
+
+        unhex_val = unhex[(unsigned char)ch];
+
+        if (unhex_val == -1) {
+          if (ch == ';' || ch == ' ') {
+            UPDATE_STATE(s_chunk_parameters);
+            break;
+          }
+
+          SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
+          goto error;
+        }
+
+        t = parser->content_length;
+        t *= 16;
+        t += unhex_val;
+
+        /* Overflow? Test against a conservative limit for simplicity. */
+        if (UNLIKELY((ULLONG_MAX - 16) / 16 < parser->content_length)) {
+          SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+          goto error;
+        }
+
+        parser->content_length = t;
+        break;
+      }
+
+      STATE_CASE(s_chunk_parameters):
+      {
+        assert(parser->flags & F_CHUNKED);
+        /* just ignore this shit. TODO check for overflow */
+        if (ch == CR) {
+          UPDATE_STATE(s_chunk_size_almost_done);
+          break;
+        }
+        break;
+      }
+
+      STATE_CASE(s_chunk_size_almost_done):
+      {
+        assert(parser->flags & F_CHUNKED);
+        STRICT_CHECK(ch != LF);
+
+        parser->nread = 0;
+
+        if (parser->content_length == 0) {
+          parser->flags |= F_TRAILING;
+          UPDATE_STATE(s_header_field_start);
+        } else {
+          UPDATE_STATE(s_chunk_data);
+        }
+        HEADER_RUN_START(p + 1);
+        CALLBACK_NOTIFY(chunk_header);
+        break;
+      }
+
+      STATE_CASE(s_chunk_data):
+      {
+        uint64_t to_read = MIN(parser->content_length,
+                               (uint64_t) ((data + len) - p));
+
+        assert(parser->flags & F_CHUNKED);
+        assert(parser->content_length != 0
+            && parser->content_length != ULLONG_MAX);
+
+        /* See the explanation in s_body_identity for why the content
+         * length and data pointers are managed this way.
+         */
+        MARK(body);
+        parser->content_length -= to_read;
+        SKIP_TO(p + to_read - 1);
+
+        if (parser->content_length == 0) {
+          UPDATE_STATE(s_chunk_data_almost_done);
+        }
+
+        break;
+      }
+
+      STATE_CASE(s_chunk_data_almost_done):
+        assert(parser->flags & F_CHUNKED);
+        assert(parser->content_length == 0);
+        STRICT_CHECK(ch != CR);
+        UPDATE_STATE(s_chunk_data_done);
+        CALLBACK_DATA(body);
+        break;
+
+      STATE_CASE(s_chunk_data_done):
+        assert(parser->flags & F_CHUNKED);
+        STRICT_CHECK(ch != LF);
+        parser->nread = 0;
+        UPDATE_STATE(s_chunk_size_start);
+        HEADER_RUN_START(p + 1);
+        CALLBACK_NOTIFY(chunk_complete);
+        break;
+
+      STATE_DEFAULT:
+        assert(0 && "unhandled state");
+        SET_ERRNO(HPE_INVALID_INTERNAL_STATE);
+        goto error;
+    }
+  }
+
+  /* The loop stops short of the end of the buffer only where the head
+   * would grow past HTTP_MAX_HEADER_SIZE
+   */
+  if (UNLIKELY(p != data + len)) {
+    SET_ERRNO(HPE_HEADER_OVERFLOW);
+    goto error;
+  }
+
+  /* Run callbacks for any marks that we have leftover after we ran our of
+   * bytes. There should be at most one of these set, so it's OK to invoke
+   * them in series (unset marks will not result in callbacks).
+   *
+   * We use the NOADVANCE() variety of callbacks here because 'p' has already
+   * overflowed 'data' and this allows us to correct for the off-by-one that
+   * we'd otherwise have (since CALLBACK_DATA() is meant to be run with a 'p'
+   * value that's in-bounds).
+   */
+
+  assert(((header_field_mark ? 1 : 0) +
+          (header_value_mark ? 1 : 0) +
+          (url_mark ? 1 : 0)  +
+          (body_mark ? 1 : 0) +
+          (status_mark ? 1 : 0)) <= 1);
+
+  /* A header name that continues in the next buffer can't be looked up in
+   * one go; match the part we have against the known names instead.
+   */
+  if (header_field_mark) {
+    if (header_name) {
+      parser->header_id = HTTP_HEADER_OTHER + 1;
+      parser->header_id_index = 0;
+    }
+    header_id_feed(parser, header_field_mark, p - header_field_mark);
+  }
+
+  CALLBACK_DATA_NOADVANCE(header_field);
+  CALLBACK_DATA_NOADVANCE(header_value);
+  CALLBACK_DATA_NOADVANCE(url);
+  CALLBACK_DATA_NOADVANCE(body);
+  CALLBACK_DATA_NOADVANCE(status);
+
+  RETURN(len);
+
+error:
+  if (HTTP_PARSER_ERRNO(parser) == HPE_OK) {
+    SET_ERRNO(HPE_UNKNOWN);
+  }
+
+  RETURN(p - data);
+}
+
+#ifdef EXECUTE_DETECT_NAME
+/* HTTP_BOTH: the first message says whether the stream carries requests or
+ * responses, and the engine for those takes over for good. "HTTP/..." and
+ * "HEAD ..." share their first byte, so this may have to see a second one.
+ */
+static size_t
+EXECUTE_DETECT_NAME (http_parser *parser,
+                     EXECUTE_SETTINGS *settings,
+                     const char *data,
+                     size_t len)
+{
+  const char *p = data;
+  const char *end = data + len;
+  enum state p_state = s_res_or_resp_H;       /* for CALLBACK_NOTIFY() */
+  const char *header_run = NULL;
+
+  if (HTTP_PARSER_ERRNO(parser) != HPE_OK) {
+    return 0;
+  }
+
+  if (parser->state == s_res_or_resp_H) {
+    if (len == 0) {
+      SET_ERRNO(HPE_INVALID_EOF_STATE);
+      return 1;
+    }
+
+    /* The 'H' came with the previous buffer */
+    if (*p == 'T') {
+      parser->type = HTTP_RESPONSE;
+      parser->state = s_res_H;
+    } else {
+      parser->type = HTTP_REQUEST;
+      parser->state = s_req_method;
+      parser->method = HTTP_HEAD;
+      parser->index = 1;
+    }
+    return 0;
+  }
+
+  while (p != end && (*p == CR || *p == LF)) {
+    p++;
+  }
+
+  parser->nread += p - data;
+  if (UNLIKELY(parser->nread > (HTTP_MAX_HEADER_SIZE))) {
+    SET_ERRNO(HPE_HEADER_OVERFLOW);
+    return p - data;
+  }
+
+  if (p == end) {
+    return len;
+  }
+
+  if (*p == 'H' && p + 1 == end) {
+    /* Too early to tell; do what both engines do with the first byte */
+    parser->flags = 0;
+    parser->content_length = ULLONG_MAX;
+    parser->nread++;
+    parser->state = s_res_or_resp_H;
+    CALLBACK_NOTIFY(message_begin);
+    parser->state = CURRENT_STATE();
+    return len;
+  }
+
+  if (*p == 'H' && p[1] == 'T') {
+    parser->type = HTTP_RESPONSE;
+    parser->state = s_start_res;
+  } else {
+    parser->type = HTTP_REQUEST;
+    parser->state = s_start_req;
+  }
+
+  return p - data;
+}
+#endif
+
+#undef EXECUTE_NAME
+#undef EXECUTE_DETECT_NAME
+#undef EXECUTE_HEADER_BLOCK
+#undef EXECUTE_RESPONSE
+#undef EXECUTE_SETTINGS
+#undef HAS_CALLBACK
+#undef RUN_NOTIFY_CALLBACK
+#undef RUN_DATA_CALLBACK
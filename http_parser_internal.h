@@ -0,0 +1,1254 @@
+/* Based on src/http/ngx_http_parse.c from NGINX copyright Igor Sysoev
+ *
+ * Additional changes are licensed under the same terms as NGINX and
+ * copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* The tables, states and helpers behind http_parser_engine.h.
+ *
+ * This is not a public header. http_parser.c includes it at file scope and
+ * http_parser.hpp inside a namespace, after the system headers it needs, so
+ * everything here must have internal linkage.
+ */
+#ifndef http_parser_internal_h
+#define http_parser_internal_h
+
+#include "http_parser.h"
+#include <assert.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if HTTP_PARSER_USDT
+# include <sys/sdt.h>
+#endif
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+# include <immintrin.h>
+#endif
+
+#ifndef ULLONG_MAX
+# define ULLONG_MAX ((uint64_t) -1) /* 2^64-1 */
+#endif
+
+#ifndef MIN
+# define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef ARRAY_SIZE
+# define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#ifndef BIT_AT
+# define BIT_AT(a, i)                                                \
+  (!!((unsigned int) (a)[(unsigned int) (i) >> 3] &                  \
+   (1 << ((unsigned int) (i) & 7))))
+#endif
+
+#ifndef ELEM_AT
+# define ELEM_AT(a, i, v) ((unsigned int) (i) < ARRAY_SIZE(a) ? (a)[(i)] : (v))
+#endif
+
+#define SET_ERRNO(e)                                                 \
+do {                                                                 \
+  parser->http_errno = (e);                                          \
+  if ((e) != HPE_OK && (e) != HPE_PAUSED) {                          \
+    PROBE2(error, parser, (int) (e));                                \
+  }                                                                  \
+} while(0)
+
+#define CURRENT_STATE() p_state
+#if HTTP_PARSER_STATS
+# define UPDATE_STATE(V) p_state = stats_transition(p_state, (enum state) (V));
+#else
+# define UPDATE_STATE(V) p_state = (enum state) (V);
+#endif
+/* Return V, charging the header bytes up to it; the rest are parsed again
+ * by the next call and charged then
+ */
+#define RETURN(V)                                                    \
+do {                                                                 \
+  HEADER_RUN_CHARGE(data + (V));                                     \
+  parser->state = CURRENT_STATE();                                   \
+  return (V);                                                        \
+} while (0);
+#define REEXECUTE()                                                  \
+do {                                                                 \
+  STATS_ADD(reexecutes, 1);                                          \
+  goto reexecute;                                                    \
+} while (0)
+
+/* USDT probe NAME of provider http_parser; see HTTP_PARSER_USDT */
+#if HTTP_PARSER_USDT
+# define PROBE2(NAME, A, B) STAP_PROBE2(http_parser, NAME, A, B)
+# define PROBE3(NAME, A, B, C) STAP_PROBE3(http_parser, NAME, A, B, C)
+#else
+# define PROBE2(NAME, A, B) ((void) 0)
+# define PROBE3(NAME, A, B, C) ((void) 0)
+#endif
+
+/* Count N more for the field FIELD of http_parser_stats_counters */
+#if HTTP_PARSER_STATS
+# define STATS_ADD(FIELD, N)                                         \
+  (http_parser_stats_counters.FIELD += (uint64_t) (N))
+#else
+# define STATS_ADD(FIELD, N) ((void) 0)
+#endif
+
+/* Move p on to P in one go, past bytes the state has no need to look at
+ * one by one. These count as bulk bytes of the current state.
+ */
+#if HTTP_PARSER_STATS
+# define SKIP_TO(P)                                                  \
+do {                                                                 \
+  const char *skip_to_ = (P);                                        \
+  STATS_ADD(bulk_bytes[CURRENT_STATE()], skip_to_ - p);              \
+  p = skip_to_;                                                      \
+} while (0)
+#else
+# define SKIP_TO(P) (p = (P))
+#endif
+
+/* The states of the big switch in http_parser_engine.h. With
+ * HTTP_PARSER_THREADED each one also gets a label, which the engine jumps
+ * to through a table of label addresses instead of through the switch.
+ */
+/* An explicit fall through into the next STATE_CASE(), whose expansion hides
+ * the `case` from -Wimplicit-fallthrough's comment matching
+ */
+#if defined(__has_attribute)
+# if __has_attribute(fallthrough)
+#  define FALLTHROUGH __attribute__((fallthrough))
+# endif
+#endif
+#ifndef FALLTHROUGH
+# define FALLTHROUGH do { } while (0)
+#endif
+
+#if HTTP_PARSER_THREADED
+# define STATE_CASE(S) case S: state_##S
+# define STATE_DEFAULT default: state_default
+#else
+# define STATE_CASE(S) case S
+# define STATE_DEFAULT default
+#endif
+
+
+#ifdef __GNUC__
+# define LIKELY(X) __builtin_expect(!!(X), 1)
+# define UNLIKELY(X) __builtin_expect(!!(X), 0)
+# define PREFETCH(P) __builtin_prefetch(P)
+#else
+# define LIKELY(X) (X)
+# define UNLIKELY(X) (X)
+# define PREFETCH(P) ((void) (P))
+#endif
+
+
+/* Loads 8 bytes as a little endian word, whatever the host byte order */
+static inline uint64_t
+load_le64(const char *p)
+{
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w = __builtin_bswap64(w);
+#endif
+  return w;
+}
+
+
+/* Run the notify callback FOR, returning ER if it fails */
+#define CALLBACK_NOTIFY_(FOR, ER)                                    \
+do {                                                                 \
+  assert(HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
+  PROBE3(FOR, parser, p - data, parser->content_length);             \
+                                                                     \
+  if (LIKELY(HAS_CALLBACK(FOR))) {                                   \
+    STATS_ADD(callbacks[HPE_CB_##FOR - HPE_CB_message_begin], 1);    \
+    parser->state = CURRENT_STATE();                                 \
+    if (UNLIKELY(0 != RUN_NOTIFY_CALLBACK(FOR))) {                   \
+      SET_ERRNO(HPE_CB_##FOR);                                       \
+    }                                                                \
+    UPDATE_STATE(parser->state);                                     \
+                                                                     \
+    /* We either errored above or got paused; get out */             \
+    if (UNLIKELY(HTTP_PARSER_ERRNO(parser) != HPE_OK)) {             \
+      RETURN(ER);                                                    \
+    }                                                                \
+  }                                                                  \
+} while (0)
+
+/* Run the notify callback FOR and consume the current byte */
+#define CALLBACK_NOTIFY(FOR)            CALLBACK_NOTIFY_(FOR, p - data + 1)
+
+/* Run the notify callback FOR and don't consume the current byte */
+#define CALLBACK_NOTIFY_NOADVANCE(FOR)  CALLBACK_NOTIFY_(FOR, p - data)
+
+/* Run data callback FOR with LEN bytes, returning ER if it fails */
+#define CALLBACK_DATA_(FOR, LEN, ER)                                 \
+do {                                                                 \
+  assert(HTTP_PARSER_ERRNO(parser) == HPE_OK);                       \
+                                                                     \
+  if (FOR##_mark) {                                                  \
+    if (LIKELY(HAS_CALLBACK(FOR))) {                                 \
+      STATS_ADD(callbacks[HPE_CB_##FOR - HPE_CB_message_begin], 1);  \
+      parser->state = CURRENT_STATE();                               \
+      if (UNLIKELY(0 != RUN_DATA_CALLBACK(FOR, FOR##_mark, (LEN)))) {\
+        SET_ERRNO(HPE_CB_##FOR);                                     \
+      }                                                              \
+      UPDATE_STATE(parser->state);                                   \
+                                                                     \
+      /* We either errored above or got paused; get out */           \
+      if (UNLIKELY(HTTP_PARSER_ERRNO(parser) != HPE_OK)) {           \
+        RETURN(ER);                                                  \
+      }                                                              \
+    }                                                                \
+    FOR##_mark = NULL;                                               \
+  }                                                                  \
+} while (0)
+  
+/* Run the data callback FOR and consume the current byte */
+#define CALLBACK_DATA(FOR)                                           \
+    CALLBACK_DATA_(FOR, p - FOR##_mark, p - data + 1)
+
+/* Run the data callback FOR and don't consume the current byte */
+#define CALLBACK_DATA_NOADVANCE(FOR)                                 \
+    CALLBACK_DATA_(FOR, p - FOR##_mark, p - data)
+
+/* Set the mark FOR; non-destructive if mark is already set */
+#define MARK(FOR)                                                    \
+do {                                                                 \
+  if (!FOR##_mark) {                                                 \
+    FOR##_mark = p;                                                  \
+  }                                                                  \
+} while (0)
+
+/* Don't allow the total size of the HTTP headers (including the status
+ * line) to exceed HTTP_MAX_HEADER_SIZE.  This check is here to protect
+ * embedders against denial-of-service attacks where the attacker feeds
+ * us a never-ending header that the embedder keeps buffering.
+ *
+ * This check is arguably the responsibility of embedders but we're doing
+ * it on the embedder's behalf because most won't bother and this way we
+ * make the web a little safer.  HTTP_MAX_HEADER_SIZE is still far bigger
+ * than any reasonable request or response so this should never affect
+ * day-to-day operation.
+ *
+ * Rather than counting every byte, the engine keeps the start of the
+ * header bytes it hasn't charged yet in header_run and stops its loop at
+ * p_end, the first byte that would take the head over the limit. A run is
+ * charged to parser->nread when it ends: when the message moves on to its
+ * body and when the engine returns. The body states run up to the end of
+ * the buffer.
+ *
+ * The header block engine only runs on heads that are known to fit and
+ * doesn't count at all.
+ */
+
+/* Header bytes are counted from P on; also sets p_end for the current state */
+#define HEADER_RUN_START(P)                                          \
+do {                                                                 \
+  if (!EXECUTE_HEADER_BLOCK) {                                       \
+    if (PARSING_HEADER(CURRENT_STATE())) {                           \
+      header_run = (P);                                              \
+      p_end = (P) + MIN((size_t) (data + len - (P)),                 \
+                        header_room(parser));                        \
+    } else {                                                         \
+      header_run = NULL;                                             \
+      p_end = data + len;                                            \
+    }                                                                \
+  }                                                                  \
+} while (0)
+
+/* Charge the header bytes before P, if any */
+#define HEADER_RUN_CHARGE(P)                                         \
+do {                                                                 \
+  if (!EXECUTE_HEADER_BLOCK && header_run && (P) > header_run) {     \
+    parser->nread += (uint32_t) ((P) - header_run);                  \
+    header_run = (P);                                                \
+  }                                                                  \
+} while (0)
+
+
+#define PROXY_CONNECTION "proxy-connection"
+#define CONNECTION "connection"
+#define CONTENT_LENGTH "content-length"
+#define TRANSFER_ENCODING "transfer-encoding"
+#define UPGRADE "upgrade"
+#define CHUNKED "chunked"
+#define KEEP_ALIVE "keep-alive"
+#define CLOSE "close"
+
+
+static const char *method_strings[] =
+  {
+#define XX(num, name, string) #string,
+  HTTP_METHOD_MAP(XX)
+#undef XX
+  };
+
+
+/* Eight characters as the little endian word load_le64() returns */
+#define LE_WORD(a, b, c, d, e, f, g, h)                              \
+  ((uint64_t) (a)       | (uint64_t) (b) <<  8 |                     \
+   (uint64_t) (c) << 16 | (uint64_t) (d) << 24 |                     \
+   (uint64_t) (e) << 32 | (uint64_t) (f) << 40 |                     \
+   (uint64_t) (g) << 48 | (uint64_t) (h) << 56)
+
+/* Mask over the first `len` characters of such a word */
+#define LE_MASK(len)                                                 \
+  ((len) == 8 ? ~(uint64_t) 0 : ((uint64_t) 1 << ((len) * 8)) - 1)
+
+
+/* Methods that fit in one 8 byte word together with the space that ends
+ * them, as little endian words and masks over the bytes they use. Ordered
+ * by how common the method is; the rest are left to s_req_method.
+ */
+#define METHOD_ENTRY(len, name, a, b, c, d, e, f, g, h)              \
+  { LE_WORD(a, b, c, d, e, f, g, h), LE_MASK(len), len, HTTP_##name }
+
+static const struct {
+  uint64_t word;
+  uint64_t mask;
+  uint8_t len;
+  uint8_t method;
+} method_words[] =
+  { METHOD_ENTRY(4, GET,     'G','E','T',' ', 0,  0,  0,  0 )
+  , METHOD_ENTRY(5, POST,    'P','O','S','T',' ', 0,  0,  0 )
+  , METHOD_ENTRY(4, PUT,     'P','U','T',' ', 0,  0,  0,  0 )
+  , METHOD_ENTRY(5, HEAD,    'H','E','A','D',' ', 0,  0,  0 )
+  , METHOD_ENTRY(7, DELETE,  'D','E','L','E','T','E',' ', 0 )
+  , METHOD_ENTRY(8, OPTIONS, 'O','P','T','I','O','N','S',' ')
+  , METHOD_ENTRY(6, PATCH,   'P','A','T','C','H',' ', 0,  0 )
+  , METHOD_ENTRY(8, CONNECT, 'C','O','N','N','E','C','T',' ')
+  , METHOD_ENTRY(6, TRACE,   'T','R','A','C','E',' ', 0,  0 )
+  , METHOD_ENTRY(6, PURGE,   'P','U','R','G','E',' ', 0,  0 )
+  , METHOD_ENTRY(5, COPY,    'C','O','P','Y',' ', 0,  0,  0 )
+  , METHOD_ENTRY(5, LOCK,    'L','O','C','K',' ', 0,  0,  0 )
+  , METHOD_ENTRY(6, MKCOL,   'M','K','C','O','L',' ', 0,  0 )
+  , METHOD_ENTRY(5, MOVE,    'M','O','V','E',' ', 0,  0,  0 )
+  , METHOD_ENTRY(7, SEARCH,  'S','E','A','R','C','H',' ', 0 )
+  , METHOD_ENTRY(7, UNLOCK,  'U','N','L','O','C','K',' ', 0 )
+  , METHOD_ENTRY(7, REPORT,  'R','E','P','O','R','T',' ', 0 )
+  , METHOD_ENTRY(6, MERGE,   'M','E','R','G','E',' ', 0,  0 )
+  , METHOD_ENTRY(7, NOTIFY,  'N','O','T','I','F','Y',' ', 0 )
+  };
+
+
+static const char *header_strings[] =
+  {
+  "<other>",
+#define XX(num, name, string) #string,
+  HTTP_HEADER_MAP(XX)
+#undef XX
+  };
+
+
+static const uint8_t header_lengths[] =
+  {
+  0,
+#define XX(num, name, string) sizeof(#string) - 1,
+  HTTP_HEADER_MAP(XX)
+#undef XX
+  };
+
+
+/* Perfect hash over the names in HTTP_HEADER_MAP, see header_id_lookup().
+ * Generated by contrib/header_hash.c; regenerate when the map changes.
+ */
+static const uint8_t header_hash_asso[256] =
+  {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,214,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,203,  0, 30, 52, 60,186,230,214,105,  0, 65,122,228,159,114
+  ,135,  0,236,161,245,128,240, 82,240, 85,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  };
+
+static const uint8_t header_hash_slots[256] =
+  {  0,  0, 17,  0,  0,  0,  0, 49,  0,  0,  9,  0,  0,  0,  0,  0
+  ,  0,  0,  0,  0, 15,  0,  4, 41,  0,  0,  0,  0,  8,  0,  0,  0
+  ,  0, 39, 10,  0,  0,  0, 25,  0,  0,  0,  0,  0, 24, 45,  0,  0
+  , 69, 50,  0, 54,  0,  0, 44, 26,  0, 43, 58,  0,  0,  0,  0, 62
+  ,  0,  0,  0,  0,  0,  0,  0, 31,  0, 60,  0,  0, 33,  0,  0,  0
+  ,  0,  0,  0,  0,  0, 51,  0,  0, 42,  0, 48,  0,  0,  0,  0,  0
+  , 22,  0,  0,  0,  0,  0, 21, 20,  0,  0, 16,  0,  0,  0,  0,  0
+  ,  0,  0,  0, 67, 23,  0,  0, 11,  0,  5,  0,  0,  0,  0,  0, 59
+  , 68,  0,  0,  0,  0,  6,  0, 36,  0,  0,  7,  0,  0,  0,  0,  0
+  ,  0, 40,  0, 52,  0,  0,  0,  0,  0,  0,  0, 64,  0,  0, 63,  0
+  ,  0,  0, 29,  0,  0, 12,  0,  0,  0,  0,  0,  0,  0, 34,  0,  0
+  ,  0,  0,  0,  0,  0,  0, 32,  0, 35,  0,  0, 37,  0,  0, 61, 38
+  ,  3,  0,  0, 57,  0,  0,  1, 13,  0,  0,  0,  0,  0, 18,  2, 30
+  , 14,  0,  0,  0,  0,  0, 70,  0,  0,  0,  0,  0,  0,  0,  0, 46
+  ,  0,  0,  0, 47, 27,  0,  0, 53, 55,  0,  0, 65, 56,  0,  0,  0
+  ,  0,  0,  0,  0,  0, 66,  0, 28,  0,  0,  0,  0,  0,  0,  0, 19
+  };
+
+
+/* Tokens as defined by rfc 2616. Also lowercases them.
+ *        token       = 1*<any CHAR except CTLs or separators>
+ *     separators     = "(" | ")" | "<" | ">" | "@"
+ *                    | "," | ";" | ":" | "\" | <">
+ *                    | "/" | "[" | "]" | "?" | "="
+ *                    | "{" | "}" | SP | HT
+ */
+static const char tokens[256] = {
+/*   0 nul    1 soh    2 stx    3 etx    4 eot    5 enq    6 ack    7 bel  */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*   8 bs     9 ht    10 nl    11 vt    12 np    13 cr    14 so    15 si   */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*  16 dle   17 dc1   18 dc2   19 dc3   20 dc4   21 nak   22 syn   23 etb */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*  24 can   25 em    26 sub   27 esc   28 fs    29 gs    30 rs    31 us  */
+        0,       0,       0,       0,       0,       0,       0,       0,
+/*  32 sp    33  !    34  "    35  #    36  $    37  %    38  &    39  '  */
+        0,      '!',      0,      '#',     '$',     '%',     '&',    '\'',
+/*  40  (    41  )    42  *    43  +    44  ,    45  -    46  .    47  /  */
+        0,       0,      '*',     '+',      0,      '-',     '.',      0,
+/*  48  0    49  1    50  2    51  3    52  4    53  5    54  6    55  7  */
+       '0',     '1',     '2',     '3',     '4',     '5',     '6',     '7',
+/*  56  8    57  9    58  :    59  ;    60  <    61  =    62  >    63  ?  */
+       '8',     '9',      0,       0,       0,       0,       0,       0,
+/*  64  @    65  A    66  B    67  C    68  D    69  E    70  F    71  G  */
+        0,      'a',     'b',     'c',     'd',     'e',     'f',     'g',
+/*  72  H    73  I    74  J    75  K    76  L    77  M    78  N    79  O  */
+       'h',     'i',     'j',     'k',     'l',     'm',     'n',     'o',
+/*  80  P    81  Q    82  R    83  S    84  T    85  U    86  V    87  W  */
+       'p',     'q',     'r',     's',     't',     'u',     'v',     'w',
+/*  88  X    89  Y    90  Z    91  [    92  \    93  ]    94  ^    95  _  */
+       'x',     'y',     'z',      0,       0,       0,      '^',     '_',
+/*  96  `    97  a    98  b    99  c   100  d   101  e   102  f   103  g  */
+       '`',     'a',     'b',     'c',     'd',     'e',     'f',     'g',
+/* 104  h   105  i   106  j   107  k   108  l   109  m   110  n   111  o  */
+       'h',     'i',     'j',     'k',     'l',     'm',     'n',     'o',
+/* 112  p   113  q   114  r   115  s   116  t   117  u   118  v   119  w  */
+       'p',     'q',     'r',     's',     't',     'u',     'v',     'w',
+/* 120  x   121  y   122  z   123  {   124  |   125  }   126  ~   127 del */
+       'x',     'y',     'z',      0,      '|',      0,      '~',       0 };
+
+
+static const int8_t unhex[256] =
+  {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  , 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,-1,-1,-1,-1,-1,-1
+  ,-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,10,11,12,13,14,15,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  ,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
+  };
+
+
+#if HTTP_PARSER_STRICT
+# define T(v) 0
+#else
+# define T(v) v
+#endif
+
+
+static const uint8_t normal_url_char[32] = {
+/*   0 nul    1 soh    2 stx    3 etx    4 eot    5 enq    6 ack    7 bel  */
+        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
+/*   8 bs     9 ht    10 nl    11 vt    12 np    13 cr    14 so    15 si   */
+        0    | T(2)   |   0    |   0    | T(16)  |   0    |   0    |   0,
+/*  16 dle   17 dc1   18 dc2   19 dc3   20 dc4   21 nak   22 syn   23 etb */
+        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
+/*  24 can   25 em    26 sub   27 esc   28 fs    29 gs    30 rs    31 us  */
+        0    |   0    |   0    |   0    |   0    |   0    |   0    |   0,
+/*  32 sp    33  !    34  "    35  #    36  $    37  %    38  &    39  '  */
+        0    |   2    |   4    |   0    |   16   |   32   |   64   |  128,
+/*  40  (    41  )    42  *    43  +    44  ,    45  -    46  .    47  /  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  48  0    49  1    50  2    51  3    52  4    53  5    54  6    55  7  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  56  8    57  9    58  :    59  ;    60  <    61  =    62  >    63  ?  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |   0,
+/*  64  @    65  A    66  B    67  C    68  D    69  E    70  F    71  G  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  72  H    73  I    74  J    75  K    76  L    77  M    78  N    79  O  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  80  P    81  Q    82  R    83  S    84  T    85  U    86  V    87  W  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  88  X    89  Y    90  Z    91  [    92  \    93  ]    94  ^    95  _  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/*  96  `    97  a    98  b    99  c   100  d   101  e   102  f   103  g  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/* 104  h   105  i   106  j   107  k   108  l   109  m   110  n   111  o  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/* 112  p   113  q   114  r   115  s   116  t   117  u   118  v   119  w  */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |  128,
+/* 120  x   121  y   122  z   123  {   124  |   125  }   126  ~   127 del */
+        1    |   2    |   4    |   8    |   16   |   32   |   64   |   0, };
+
+#undef T
+
+enum state
+  { s_dead = 1 /* important that this is > 0 */
+
+  , s_start_req_or_res
+  , s_res_or_resp_H
+  , s_start_res
+  , s_res_H
+  , s_res_HT
+  , s_res_HTT
+  , s_res_HTTP
+  , s_res_first_http_major
+  , s_res_http_major
+  , s_res_first_http_minor
+  , s_res_http_minor
+  , s_res_first_status_code
+  , s_res_status_code
+  , s_res_status_start
+  , s_res_status
+  , s_res_line_almost_done
+
+  , s_start_req
+
+  , s_req_method
+  , s_req_spaces_before_url
+  , s_req_schema
+  , s_req_schema_slash
+  , s_req_schema_slash_slash
+  , s_req_server_start
+  , s_req_server
+  , s_req_server_with_at
+  , s_req_path
+  , s_req_query_string_start
+  , s_req_query_string
+  , s_req_fragment_start
+  , s_req_fragment
+  , s_req_http_start
+  , s_req_http_H
+  , s_req_http_HT
+  , s_req_http_HTT
+  , s_req_http_HTTP
+  , s_req_first_http_major
+  , s_req_http_major
+  , s_req_first_http_minor
+  , s_req_http_minor
+  , s_req_line_almost_done
+
+  , s_header_field_start
+  , s_header_field
+  , s_header_value_discard_ws
+  , s_header_value_discard_ws_almost_done
+  , s_header_value_discard_lws
+  , s_header_value_start
+  , s_header_value
+  , s_header_value_lws
+
+  , s_header_almost_done
+
+  , s_chunk_size_start
+  , s_chunk_size
+  , s_chunk_parameters
+  , s_chunk_size_almost_done
+
+  , s_headers_almost_done
+  , s_headers_done
+
+  /* Important: 's_headers_done' must be the last 'header' state. All
+   * states beyond this must be 'body' states. It is used for overflow
+   * checking. See the PARSING_HEADER() macro.
+   */
+
+  , s_chunk_data
+  , s_chunk_data_almost_done
+  , s_chunk_data_done
+
+  , s_body_identity
+  , s_body_identity_eof
+
+  , s_message_done
+  };
+
+
+#define PARSING_HEADER(state) (state <= s_headers_done)
+
+/* How many more header bytes the current head may have */
+static inline size_t
+header_room(const http_parser *parser)
+{
+  return parser->nread < HTTP_MAX_HEADER_SIZE
+    ? HTTP_MAX_HEADER_SIZE - parser->nread
+    : 0;
+}
+
+#if HTTP_PARSER_STATS
+/* Fails to compile if HTTP_PARSER_STATS_STATES is too small for enum state */
+enum { stats_states_fit = 1 / (s_message_done < HTTP_PARSER_STATS_STATES) };
+
+/* UPDATE_STATE() with the transition counted */
+static inline enum state
+stats_transition(enum state from, enum state to)
+{
+  /* Both may come from parser->state, which has room for more */
+  if (from != to &&
+      (unsigned int) from < HTTP_PARSER_STATS_STATES &&
+      (unsigned int) to < HTTP_PARSER_STATS_STATES) {
+    http_parser_stats_counters.transitions[from][to]++;
+  }
+  return to;
+}
+#endif
+
+
+enum header_states
+  { h_general = 0
+  , h_C
+  , h_CO
+  , h_CON
+
+  , h_matching_connection
+  , h_matching_proxy_connection
+  , h_matching_content_length
+  , h_matching_transfer_encoding
+  , h_matching_upgrade
+
+  , h_connection
+  , h_content_length
+  , h_transfer_encoding
+  , h_upgrade
+
+  , h_matching_transfer_encoding_chunked
+  , h_matching_connection_token_start
+  , h_matching_connection_keep_alive
+  , h_matching_connection_close
+  , h_matching_connection_upgrade
+  , h_matching_connection_token
+
+  , h_transfer_encoding_chunked
+  , h_connection_keep_alive
+  , h_connection_close
+  , h_connection_upgrade
+  };
+
+/* Macros for character classes; depends on strict-mode  */
+#define CR                  '\r'
+#define LF                  '\n'
+#define LOWER(c)            (unsigned char)(c | 0x20)
+#define IS_ALPHA(c)         (LOWER(c) >= 'a' && LOWER(c) <= 'z')
+#define IS_NUM(c)           ((c) >= '0' && (c) <= '9')
+#define IS_ALPHANUM(c)      (IS_ALPHA(c) || IS_NUM(c))
+#define IS_HEX(c)           (IS_NUM(c) || (LOWER(c) >= 'a' && LOWER(c) <= 'f'))
+#define IS_MARK(c)          ((c) == '-' || (c) == '_' || (c) == '.' || \
+  (c) == '!' || (c) == '~' || (c) == '*' || (c) == '\'' || (c) == '(' || \
+  (c) == ')')
+#define IS_USERINFO_CHAR(c) (IS_ALPHANUM(c) || IS_MARK(c) || (c) == '%' || \
+  (c) == ';' || (c) == ':' || (c) == '&' || (c) == '=' || (c) == '+' || \
+  (c) == '$' || (c) == ',')
+
+#define STRICT_TOKEN(c)     (tokens[(unsigned char)c])
+
+#if HTTP_PARSER_STRICT
+#define TOKEN(c)            (tokens[(unsigned char)c])
+#define IS_URL_CHAR(c)      (BIT_AT(normal_url_char, (unsigned char)c))
+#define IS_HOST_CHAR(c)     (IS_ALPHANUM(c) || (c) == '.' || (c) == '-')
+#else
+#define TOKEN(c)            ((c == ' ') ? ' ' : tokens[(unsigned char)c])
+#define IS_URL_CHAR(c)                                                         \
+  (BIT_AT(normal_url_char, (unsigned char)c) || ((c) & 0x80))
+#define IS_HOST_CHAR(c)                                                        \
+  (IS_ALPHANUM(c) || (c) == '.' || (c) == '-' || (c) == '_')
+#endif
+
+
+#define start_state (EXECUTE_RESPONSE ? s_start_res : s_start_req)
+
+
+#if HTTP_PARSER_STRICT
+# define STRICT_CHECK(cond)                                          \
+do {                                                                 \
+  if (cond) {                                                        \
+    SET_ERRNO(HPE_STRICT);                                           \
+    goto error;                                                      \
+  }                                                                  \
+} while (0)
+# define NEW_MESSAGE() (http_should_keep_alive(parser) ? start_state : s_dead)
+#else
+# define STRICT_CHECK(cond)
+# define NEW_MESSAGE() start_state
+#endif
+
+
+
+/* Reads the decimal digits at the start of the little endian word `w`:
+ * returns how many there are, up to 8, and stores their value. Works on
+ * the whole word instead of a multiply per digit.
+ */
+static inline unsigned int
+decimal_le64(uint64_t w, uint64_t *value)
+{
+  /* Digits become 0..9; any other byte keeps a bit in its high nibble or
+   * carries into it when 6 is added
+   */
+  uint64_t t = w ^ 0x3030303030303030ull;
+  uint64_t nondigit = (t & 0xf0f0f0f0f0f0f0f0ull) |
+                      ((t + 0x0606060606060606ull) & 0x1010101010101010ull);
+  unsigned int n;
+
+  if (nondigit == 0) {
+    n = 8;
+  } else {
+#ifdef __GNUC__
+    n = __builtin_ctzll(nondigit) / 8;
+#else
+    for (n = 0; !(nondigit & 0xff); n++) {
+      nondigit >>= 8;
+    }
+#endif
+    if (n == 0) {
+      *value = 0;
+      return 0;
+    }
+  }
+
+  /* Right-align the digits, then combine pairs, quads and octets */
+  t <<= 64 - 8 * n;
+  t = (t * 10 + (t >> 8)) & 0x00ff00ff00ff00ffull;
+  t = (t * 100 + (t >> 16)) & 0x0000ffff0000ffffull;
+  t = (t * 10000 + (t >> 32)) & 0x00000000ffffffffull;
+  *value = t;
+  return n;
+}
+
+/* The hex counterpart of decimal_le64(): returns how many hex digits the
+ * word starts with, up to 8, and stores their value.
+ */
+static inline unsigned int
+hex_le64(uint64_t w, uint64_t *value)
+{
+  /* A byte x < 0x80 is in (lo, hi) when both x + 0x7f - lo and
+   * 0x7f + hi - x have their high bit set; neither sum carries into the
+   * next byte.
+   */
+#define BYTES(b) ((uint64_t) (b) * 0x0101010101010101ull)
+#define IN_RANGE(x, lo, hi)                                          \
+  (((BYTES(0x7f + (hi)) - ((x) & BYTES(0x7f))) &                     \
+    (((x) & BYTES(0x7f)) + BYTES(0x7f - (lo))) & ~(x)) & BYTES(0x80))
+  uint64_t lower = w | BYTES(0x20);
+  uint64_t digit = IN_RANGE(w, '0' - 1, '9' + 1);
+  uint64_t letter = IN_RANGE(lower, 'a' - 1, 'f' + 1);
+  uint64_t nonhex = ~(digit | letter) & BYTES(0x80);
+  uint64_t t;
+  unsigned int n;
+#undef IN_RANGE
+
+  if (nonhex == 0) {
+    n = 8;
+  } else {
+#ifdef __GNUC__
+    n = __builtin_ctzll(nonhex) / 8;
+#else
+    for (n = 0; !(nonhex & 0xff); n++) {
+      nonhex >>= 8;
+    }
+#endif
+    if (n == 0) {
+      *value = 0;
+      return 0;
+    }
+  }
+
+  /* 0-9 are the low nibble, a-f the low nibble plus 9 */
+  t = (w & BYTES(0x0f)) + (letter >> 7) * 9;
+#undef BYTES
+
+  t <<= 64 - 8 * n;
+  t = (t * 16 + (t >> 8)) & 0x00ff00ff00ff00ffull;
+  t = (t * 256 + (t >> 16)) & 0x0000ffff0000ffffull;
+  t = (t * 65536 + (t >> 32)) & 0x00000000ffffffffull;
+  *value = t;
+  return n;
+}
+
+/* Parses the number at p in one go when it is short and the byte after it
+ * is in [p, end): returns the number of digits, at most 15, and stores the
+ * value, which can't overflow. Returns 0 otherwise, leaving longer numbers
+ * and numbers cut short by `end` to the byte-wise parser.
+ */
+static inline size_t
+parse_decimal(const char *p, const char *end, uint64_t *value)
+{
+  static const uint64_t pow10[8] =
+    { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000 };
+  uint64_t hi, lo;
+  unsigned int n;
+
+  if (end - p < 8) {
+    return 0;
+  }
+
+  n = decimal_le64(load_le64(p), &hi);
+  if (n < 8) {
+    *value = hi;
+    return n;
+  }
+
+  if (end - p < 16) {
+    return 0;
+  }
+
+  n = decimal_le64(load_le64(p + 8), &lo);
+  if (n == 8) {
+    return 0;
+  }
+
+  *value = hi * pow10[n] + lo;
+  return 8 + n;
+}
+
+
+/* Returns a pointer to the first CR or LF in [p, end), or `end` if there is
+ * none. Unlike a pair of memchr() calls this touches every byte only once,
+ * which matters for long header values (cookies, user agents, ...).
+ */
+static inline const char *
+find_crlf(const char *p, const char *end)
+{
+#if defined(__AVX2__)
+  {
+    const __m256i cr32 = _mm256_set1_epi8(CR);
+    const __m256i lf32 = _mm256_set1_epi8(LF);
+
+    for (; end - p >= 32; p += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *) p);
+      unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+          _mm256_or_si256(_mm256_cmpeq_epi8(v, cr32),
+                          _mm256_cmpeq_epi8(v, lf32)));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i cr16 = _mm_set1_epi8(CR);
+    const __m128i lf16 = _mm_set1_epi8(LF);
+
+    for (; end - p >= 16; p += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *) p);
+      unsigned int mask = (unsigned int) _mm_movemask_epi8(
+          _mm_or_si128(_mm_cmpeq_epi8(v, cr16), _mm_cmpeq_epi8(v, lf16)));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+
+  for (; p != end; p++) {
+    if (*p == CR || *p == LF) {
+      return p;
+    }
+  }
+
+  return end;
+}
+
+
+/* Returns a pointer to the first byte in [p, end) that is not a strict
+ * (rfc 2616) token character, or `end` if there is none.
+ *
+ * The vector versions classify 16 or 32 bytes at a time with a nibble
+ * lookup: bit `h` of token_lo_nibbles[l] is set when the byte 0xhl is a
+ * token. Bytes >= 0x80 have no bit in the high nibble table and therefore
+ * never match.
+ */
+static inline const char *
+find_non_token(const char *p, const char *end)
+{
+#if defined(__SSSE3__)
+  const __m128i lo_lut = _mm_setr_epi8(
+      0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc,
+      0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70);
+  const __m128i hi_lut = _mm_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+
+# if defined(__AVX2__)
+  {
+    const __m256i lo_lut32 = _mm256_broadcastsi128_si256(lo_lut);
+    const __m256i hi_lut32 = _mm256_broadcastsi128_si256(hi_lut);
+    const __m256i nibble32 = _mm256_broadcastsi128_si256(nibble);
+    const __m256i zero32 = _mm256_setzero_si256();
+
+    for (; end - p >= 32; p += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *) p);
+      __m256i lo = _mm256_shuffle_epi8(lo_lut32,
+                                       _mm256_and_si256(v, nibble32));
+      __m256i hi = _mm256_shuffle_epi8(
+          hi_lut32, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble32));
+      unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), zero32));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+# endif
+
+  for (; end - p >= 16; p += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+    __m128i lo = _mm_shuffle_epi8(lo_lut, _mm_and_si128(v, nibble));
+    __m128i hi = _mm_shuffle_epi8(hi_lut,
+                                  _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    unsigned int mask = (unsigned int) _mm_movemask_epi8(
+        _mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()));
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+  }
+#endif
+
+  for (; p != end; p++) {
+    if (!STRICT_TOKEN(*p)) {
+      return p;
+    }
+  }
+
+  return end;
+}
+
+/* Returns the id of a complete, contiguous header name. */
+static inline enum http_header_id
+header_id_lookup(const char *name, size_t len)
+{
+  const char *expected;
+  unsigned char first;
+  unsigned char last;
+  unsigned int id;
+  size_t i;
+
+  if (len == 0) {
+    return HTTP_HEADER_OTHER;
+  }
+
+  first = (unsigned char) STRICT_TOKEN(name[0]);
+  last = (unsigned char) STRICT_TOKEN(name[len - 1]);
+  id = header_hash_slots[(len + header_hash_asso[first] +
+                          header_hash_asso[last]) & 0xff];
+  if (id == HTTP_HEADER_OTHER || header_lengths[id] != len) {
+    return HTTP_HEADER_OTHER;
+  }
+
+  expected = header_strings[id];
+  for (i = 0; i < len; i++) {
+    if (STRICT_TOKEN(name[i]) != expected[i]) {
+      return HTTP_HEADER_OTHER;
+    }
+  }
+
+  return (enum http_header_id) id;
+}
+
+/* Matches the next piece of a header name that arrives in several buffers.
+ * parser->header_id holds the first name in HTTP_HEADER_MAP that starts with
+ * the bytes seen so far (HTTP_HEADER_OTHER if none does) and
+ * parser->header_id_index the number of bytes seen. Since the map is sorted,
+ * all candidates sharing that prefix follow each other.
+ */
+static void
+header_id_feed(http_parser *parser, const char *p, size_t len)
+{
+  unsigned int id = parser->header_id;
+  unsigned int i = parser->header_id_index;
+
+  for (; len != 0 && id != HTTP_HEADER_OTHER; p++, len--, i++) {
+    char c = STRICT_TOKEN(*p);
+
+    if (c == '\0') {
+      id = HTTP_HEADER_OTHER;
+      break;
+    }
+
+    while (header_strings[id][i] != c) {
+      if ((unsigned char) header_strings[id][i] > (unsigned char) c ||
+          id + 1 >= ARRAY_SIZE(header_strings) ||
+          strncmp(header_strings[id], header_strings[id + 1], i) != 0) {
+        id = HTTP_HEADER_OTHER;
+        break;
+      }
+      id++;
+    }
+  }
+
+  parser->header_id = id;
+  parser->header_id_index = i;
+}
+
+/* Completes header_id_feed() once the end of the name has been seen. */
+static enum http_header_id
+header_id_finish(const http_parser *parser)
+{
+  unsigned int id = parser->header_id;
+
+  if (id != HTTP_HEADER_OTHER &&
+      header_lengths[id] == parser->header_id_index) {
+    return (enum http_header_id) id;
+  }
+
+  return HTTP_HEADER_OTHER;
+}
+
+/* Returns a pointer to the first byte in [p, end) that may end or change
+ * the current URL component, or `end` if there is none. Every byte skipped
+ * here is a printable ASCII character other than '#' and '?', which is
+ * IS_URL_CHAR() in both strict and non-strict mode. Anything else,
+ * including characters that are only valid in non-strict mode, is left to
+ * parse_url_char().
+ */
+static inline const char *
+find_url_delimiter(const char *p, const char *end)
+{
+#if defined(__AVX2__)
+  {
+    const __m256i lo32 = _mm256_set1_epi8(' ');
+    const __m256i hi32 = _mm256_set1_epi8(127);
+    const __m256i hash32 = _mm256_set1_epi8('#');
+    const __m256i qmark32 = _mm256_set1_epi8('?');
+
+    for (; end - p >= 32; p += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *) p);
+      /* Signed compares, so bytes >= 0x80 fall outside the range */
+      __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo32),
+                                    _mm256_cmpgt_epi8(hi32, v));
+      __m256i delim = _mm256_or_si256(_mm256_cmpeq_epi8(v, hash32),
+                                      _mm256_cmpeq_epi8(v, qmark32));
+      unsigned int mask = ~(unsigned int) _mm256_movemask_epi8(
+          _mm256_andnot_si256(delim, ok));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i lo16 = _mm_set1_epi8(' ');
+    const __m128i hi16 = _mm_set1_epi8(127);
+    const __m128i hash16 = _mm_set1_epi8('#');
+    const __m128i qmark16 = _mm_set1_epi8('?');
+
+    for (; end - p >= 16; p += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *) p);
+      __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo16),
+                                 _mm_cmplt_epi8(v, hi16));
+      __m128i delim = _mm_or_si128(_mm_cmpeq_epi8(v, hash16),
+                                   _mm_cmpeq_epi8(v, qmark16));
+      unsigned int mask = 0xffff & ~(unsigned int) _mm_movemask_epi8(
+          _mm_andnot_si128(delim, ok));
+      if (mask != 0) {
+        return p + __builtin_ctz(mask);
+      }
+    }
+  }
+#endif
+
+  for (; p != end; p++) {
+    if (*p <= ' ' || *p >= 127 || *p == '#' || *p == '?') {
+      return p;
+    }
+  }
+
+  return end;
+}
+
+/* Our URL parser.
+ *
+ * This is designed to be shared by http_parser_execute() for URL validation,
+ * hence it has a state transition + byte-for-byte interface. In addition, it
+ * is meant to be embedded in http_parser_parse_url(), which does the dirty
+ * work of turning state transitions URL components for its API.
+ *
+ * This function should only be invoked with non-space characters. It is
+ * assumed that the caller cares about (and can detect) the transition between
+ * URL and non-URL states by looking for these.
+ */
+static enum state
+parse_url_char(enum state s, const char ch)
+{
+  if (ch == ' ' || ch == '\r' || ch == '\n') {
+    return s_dead;
+  }
+
+#if HTTP_PARSER_STRICT
+  if (ch == '\t' || ch == '\f') {
+    return s_dead;
+  }
+#endif
+
+  switch (s) {
+    case s_req_spaces_before_url:
+      /* Proxied requests are followed by scheme of an absolute URI (alpha).
+       * All methods except CONNECT are followed by '/' or '*'.
+       */
+
+      if (ch == '/' || ch == '*') {
+        return s_req_path;
+      }
+
+      if (IS_ALPHA(ch)) {
+        return s_req_schema;
+      }
+
+      break;
+
+    case s_req_schema:
+      if (IS_ALPHA(ch)) {
+        return s;
+      }
+
+      if (ch == ':') {
+        return s_req_schema_slash;
+      }
+
+      break;
+
+    case s_req_schema_slash:
+      if (ch == '/') {
+        return s_req_schema_slash_slash;
+      }
+
+      break;
+
+    case s_req_schema_slash_slash:
+      if (ch == '/') {
+        return s_req_server_start;
+      }
+
+      break;
+
+    case s_req_server_with_at:
+      if (ch == '@') {
+        return s_dead;
+      }
+
+    /* FALLTHROUGH */
+    case s_req_server_start:
+    case s_req_server:
+      if (ch == '/') {
+        return s_req_path;
+      }
+
+      if (ch == '?') {
+        return s_req_query_string_start;
+      }
+
+      if (ch == '@') {
+        return s_req_server_with_at;
+      }
+
+      if (IS_USERINFO_CHAR(ch) || ch == '[' || ch == ']') {
+        return s_req_server;
+      }
+
+      break;
+
+    case s_req_path:
+      if (IS_URL_CHAR(ch)) {
+        return s;
+      }
+
+      switch (ch) {
+        case '?':
+          return s_req_query_string_start;
+
+        case '#':
+          return s_req_fragment_start;
+      }
+
+      break;
+
+    case s_req_query_string_start:
+    case s_req_query_string:
+      if (IS_URL_CHAR(ch)) {
+        return s_req_query_string;
+      }
+
+      switch (ch) {
+        case '?':
+          /* allow extra '?' in query string */
+          return s_req_query_string;
+
+        case '#':
+          return s_req_fragment_start;
+      }
+
+      break;
+
+    case s_req_fragment_start:
+      if (IS_URL_CHAR(ch)) {
+        return s_req_fragment;
+      }
+
+      switch (ch) {
+        case '?':
+          return s_req_fragment;
+
+        case '#':
+          return s;
+      }
+
+      break;
+
+    case s_req_fragment:
+      if (IS_URL_CHAR(ch)) {
+        return s;
+      }
+
+      switch (ch) {
+        case '?':
+        case '#':
+          return s;
+      }
+
+      break;
+
+    default:
+      break;
+  }
+
+  /* We should never fall out of the switch above unless there's an error */
+  return s_dead;
+}
+
+#endif
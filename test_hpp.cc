@@ -0,0 +1,297 @@
+/* Copyright Joyent, Inc. and other Node contributors. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Runs the same streams through http_parser_execute() and
+ * http::basic_parser and checks that both report the same callbacks, byte
+ * counts and errors, whatever way the stream is split.
+ */
+
+/* Macros of the includer's own that share names with the state machine's;
+ * http_parser.hpp must neither clash with them nor drop them.
+ */
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define TOKEN 42
+
+#include "http_parser.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+struct stream {
+  const char *name;
+  enum http_parser_type type;
+  const char *raw;
+};
+
+static const stream streams[] = {
+  { "keep-alive requests", HTTP_REQUEST,
+    "GET /favicon.ico?a=b#c HTTP/1.1\r\n"
+    "Host: 0.0.0.0=5000\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n"
+    "POST /post_chunked_all_your_base HTTP/1.1\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "1e\r\nall your base are belong to us\r\n"
+    "0\r\n"
+    "Vary: *\r\n"
+    "\r\n"
+    "PUT /x HTTP/1.1\r\n"
+    "Content-Length: 5\r\n"
+    "X-Folded: a\r\n"
+    " b\r\n"
+    "\r\n"
+    "hello" },
+  { "upgrade request", HTTP_REQUEST,
+    "GET /demo HTTP/1.1\r\n"
+    "Connection: Upgrade\r\n"
+    "Upgrade: WebSocket\r\n"
+    "\r\n"
+    "Hot diggity dogg" },
+  { "bad request", HTTP_REQUEST,
+    "GET / HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Bad@Header: x\r\n"
+    "\r\n" },
+  { "responses", HTTP_RESPONSE,
+    "HTTP/1.1 100 Continue\r\n"
+    "\r\n"
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 11\r\n"
+    "\r\n"
+    "hello world"
+    "HTTP/1.1 204 No Content\r\n"
+    "\r\n"
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "\r\n"
+    "read until EOF" },
+  { "detected response", HTTP_BOTH,
+    "HTTP/1.1 301 Moved Permanently\r\n"
+    "Location: http://www.google.com/\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "5\r\nhello\r\n0\r\n\r\n" },
+  { "detected request", HTTP_BOTH,
+    "\r\nHEAD / HTTP/1.1\r\n"
+    "\r\n"
+    "HEAD /again HTTP/1.1\r\n"
+    "\r\n" },
+};
+
+/* Both sides append every callback to a log like "U(/x)F(Host)V(a)H" */
+static void
+log_notify(std::string *log, char what)
+{
+  log->push_back(what);
+}
+
+static void
+log_data(std::string *log, char what, const char *at, size_t length)
+{
+  /* Data callbacks may be split; merge the pieces of one element */
+  if (log->size() < 2 || (*log)[log->size() - 1] != ')' ||
+      (*log)[log->rfind('(') - 1] != what) {
+    log->push_back(what);
+    log->push_back('(');
+  } else {
+    log->pop_back();
+  }
+  log->append(at, length);
+  log->push_back(')');
+}
+
+#define C_NOTIFY(FOR, WHAT)                                          \
+static int                                                           \
+c_on_##FOR(http_parser *p)                                           \
+{                                                                    \
+  log_notify(static_cast<std::string *>(p->data), WHAT);             \
+  return 0;                                                          \
+}
+
+#define C_DATA(FOR, WHAT)                                            \
+static int                                                           \
+c_on_##FOR(http_parser *p, const char *at, size_t length)            \
+{                                                                    \
+  log_data(static_cast<std::string *>(p->data), WHAT, at, length);   \
+  return 0;                                                          \
+}
+
+C_NOTIFY(message_begin, 'B')
+C_DATA(url, 'U')
+C_DATA(status, 'S')
+C_DATA(header_field, 'F')
+C_DATA(header_value, 'V')
+C_NOTIFY(headers_complete, 'H')
+C_DATA(body, 'D')
+C_NOTIFY(message_complete, 'C')
+C_NOTIFY(chunk_header, 'K')
+C_NOTIFY(chunk_complete, 'k')
+
+static const http_parser_settings c_settings = {
+  c_on_message_begin, c_on_url, c_on_status, c_on_header_field,
+  c_on_header_value, c_on_headers_complete, c_on_body,
+  c_on_message_complete, c_on_chunk_header, c_on_chunk_complete
+};
+
+struct logging_parser : http::basic_parser<logging_parser> {
+  explicit logging_parser(enum http_parser_type type)
+    : basic_parser(type) {}
+
+  std::string log;
+
+  int on_message_begin() { log_notify(&log, 'B'); return 0; }
+  int on_url(const char *at, size_t length) {
+    log_data(&log, 'U', at, length);
+    return 0;
+  }
+  int on_status(const char *at, size_t length) {
+    log_data(&log, 'S', at, length);
+    return 0;
+  }
+  int on_header_field(const char *at, size_t length) {
+    log_data(&log, 'F', at, length);
+    return 0;
+  }
+  int on_header_value(const char *at, size_t length) {
+    log_data(&log, 'V', at, length);
+    return 0;
+  }
+  int on_headers_complete() { log_notify(&log, 'H'); return 0; }
+  int on_body(const char *at, size_t length) {
+    log_data(&log, 'D', at, length);
+    return 0;
+  }
+  int on_message_complete() { log_notify(&log, 'C'); return 0; }
+  int on_chunk_header() { log_notify(&log, 'K'); return 0; }
+  int on_chunk_complete() { log_notify(&log, 'k'); return 0; }
+};
+
+/* Feeds `raw` in two pieces split at `split`, then EOF, and logs the
+ * return values and the error next to the callbacks.
+ */
+template <class Execute>
+static void
+feed(std::string *log, const char *raw, size_t split, Execute execute)
+{
+  size_t len = strlen(raw);
+  size_t n = execute(raw, split);
+
+  log->append("|" + std::to_string(n) + "|");
+  if (n == split) {
+    n = execute(raw + split, len - split);
+    log->append("|" + std::to_string(n) + "|");
+    if (n == len - split) {
+      log->append("|" + std::to_string(execute(NULL, 0)) + "|");
+    }
+  }
+}
+
+static void
+test_same_as_c(const stream *s)
+{
+  size_t len = strlen(s->raw);
+  size_t split;
+
+  for (split = 0; split <= len; split++) {
+    std::string c_log;
+    http_parser c_parser;
+    http_parser_init(&c_parser, s->type);
+    c_parser.data = &c_log;
+    feed(&c_log, s->raw, split, [&](const char *data, size_t n) {
+      return http_parser_execute(&c_parser, &c_settings, data, n);
+    });
+    c_log.append(http_errno_name(HTTP_PARSER_ERRNO(&c_parser)));
+
+    logging_parser cpp_parser(s->type);
+    feed(&cpp_parser.log, s->raw, split, [&](const char *data, size_t n) {
+      return cpp_parser.execute(data, n);
+    });
+    cpp_parser.log.append(http_errno_name(cpp_parser.error()));
+
+    if (c_log != cpp_parser.log) {
+      fprintf(stderr, "\n*** %s, split at %u ***\n\nC:   %s\nC++: %s\n",
+              s->name, (unsigned) split, c_log.c_str(),
+              cpp_parser.log.c_str());
+      abort();
+    }
+  }
+}
+
+/* Only on_message_complete; the other callbacks must not be needed */
+struct counting_parser : http::basic_parser<counting_parser> {
+  counting_parser() : basic_parser(HTTP_REQUEST), messages(0) {}
+
+  unsigned messages;
+
+  void on_message_complete() {
+    if (++messages == 2) {
+      pause(true);
+    }
+  }
+};
+
+static void
+test_pause(void)
+{
+  const char *raw = "GET / HTTP/1.1\r\n\r\n"
+                    "GET / HTTP/1.1\r\n\r\n"
+                    "GET / HTTP/1.1\r\n\r\n";
+  size_t len = strlen(raw);
+  counting_parser parser;
+  size_t n;
+
+  n = parser.execute(raw, len);
+  if (n != 36 || parser.error() != HPE_PAUSED || parser.messages != 2) {
+    fprintf(stderr, "\n*** pause: %u bytes, %s, %u messages ***\n",
+            (unsigned) n, http_errno_name(parser.error()), parser.messages);
+    abort();
+  }
+
+  parser.pause(false);
+  n = parser.execute(raw + 36, len - 36);
+  if (n != len - 36 || parser.messages != 3) {
+    fprintf(stderr, "\n*** resume: %u bytes, %u messages ***\n",
+            (unsigned) n, parser.messages);
+    abort();
+  }
+}
+
+int
+main(void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+    test_same_as_c(&streams[i]);
+  }
+
+  test_pause();
+
+  static_assert(TOKEN == 42, "the includer's TOKEN was replaced");
+  if (MIN(3, 4) != 3) {
+    abort();
+  }
+
+  puts("c++ okay");
+  return 0;
+}